@@ -19,6 +19,17 @@ void handler(int sig) {
 	exit(1);
 }
 
+/**
+ * FUNCTION NAME: nowUsec
+ *
+ * DESCRIPTION: Monotonic wall clock in microseconds, used to time the simulation ticks
+ */
+static double nowUsec() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
 /**********************************
  * FUNCTION NAME: main
  *
@@ -50,8 +61,24 @@ Application::Application(char *infile) {
 	srand (time(NULL));
 	par->setparams(infile);
 	log = new Log(par);
-	en = new EmulNet(par);
-	en1 = new EmulNet(par);
+	if ( par->TRANSPORT == UDP_TRANSPORT ) {
+		en = new UdpNet(par, 0);
+		en1 = new UdpNet(par, 1);
+	}
+	else if ( par->TRANSPORT == SHM_TRANSPORT ) {
+		en = new ShmNet(par, 0);
+		en1 = new ShmNet(par, 1);
+	}
+	else {
+		en = new EmulNet(par, 0);
+		en1 = new EmulNet(par, 1);
+	}
+	tickTimeTotal = 0;
+	tickTimeMax = 0;
+	recvTimeTotal = 0;
+	failTime = -1;
+	detectTime = -1;
+	bootstrapTime = -1;
 	mp1 = (MP1Node **) malloc(par->EN_GPSZ * sizeof(MP1Node *));
 	mp2 = (MP2Node **) malloc(par->EN_GPSZ * sizeof(MP2Node *));
 
@@ -65,8 +92,15 @@ Application::Application(char *infile) {
 		Address joinaddr;
 		joinaddr = getjoinaddr();
 		addressOfMemberNode = (Address *) en->ENinit(addressOfMemberNode, par->PORTNUM);
+		// Register the node on the KV store network too; it hands out the same ids
+		en1->ENinit(addressOfMemberNode, par->PORTNUM);
 		mp1[i] = new MP1Node(memberNode, par, en, log, addressOfMemberNode);
 		mp2[i] = new MP2Node(memberNode, par, en1, log, addressOfMemberNode);
+		// The KV store rebuilds its ring only when the membership changes
+		mp1[i]->subscribe(MP2Node::membershipChanged, mp2[i]);
+		if ( par->PIGGYBACK > 0 ) {
+			mp2[i]->setMembership(mp1[i]);
+		}
 		log->LOG(&(mp1[i]->getMemberNode()->addr), "APP");
 		log->LOG(&(mp2[i]->getMemberNode()->addr), "APP MP2");
 		delete addressOfMemberNode;
@@ -104,31 +138,218 @@ int Application::run()
 
 	// As time runs along
 	for( par->globaltime = 0; par->globaltime < TOTAL_RUNNING_TIME; ++par->globaltime ) {
+		double tickStart = nowUsec();
+
 		// Run the membership protocol
 		mp1Run();
+		en->ENflush();
 
 		// Wait for all nodes to join
 		if ( par->allNodesJoined == nodeCount && !allNodesJoined ) {
 			timeWhenAllNodesHaveJoined = par->getcurrtime();
 			allNodesJoined = true;
 		}
-		if ( par->getcurrtime() > timeWhenAllNodesHaveJoined + 50 ) {
+		if ( par->CRUDTEST == MEMBERSHIP_TEST ) {
+			// Membership only run: fail some nodes and time their detection
+			trackBootstrap();
+			fail();
+			trackDetection();
+		}
+		else if ( par->getcurrtime() > timeWhenAllNodesHaveJoined + 50 ) {
 			// Call the KV store functionalities
 			mp2Run();
+			en1->ENflush();
 		}
-		// Fail some nodes
-		//fail();
+
+		double tickTime = nowUsec() - tickStart;
+		tickTimeTotal += tickTime;
+		tickTimeMax = max(tickTimeMax, tickTime);
+	}
+
+	logTickStats();
+	if ( par->CRUDTEST != MEMBERSHIP_TEST ) {
+		logPacketStats();
+	}
+	if ( par->ZONES > 1 ) {
+		logZoneStats("membership", en);
+		if ( par->CRUDTEST != MEMBERSHIP_TEST ) {
+			logZoneStats("kv store", en1);
+		}
+	}
+	if ( par->CRUDTEST == MEMBERSHIP_TEST ) {
+		logMembershipStats();
+	}
+
+	// The run is over: nodes wind up without telling each other
+	for(i=0;i<=par->EN_GPSZ-1;i++) {
+		 mp1[i]->finishUpThisNode(false);
 	}
 
 	// Clean up
 	en->ENcleanup();
 	en1->ENcleanup();
 
-	for(i=0;i<=par->EN_GPSZ-1;i++) {
-		 mp1[i]->finishUpThisNode();
+	return SUCCESS;
+}
+
+/**
+ * FUNCTION NAME: trackDetection
+ *
+ * DESCRIPTION: Failure detection benchmark. Notes the tick nodes first fail, then the tick by which
+ * 				no live node has any failed node in its membership list any more
+ */
+void Application::trackDetection() {
+	int i, j;
+	bool listed = false;
+
+	if ( detectTime >= 0 ) {
+		return;
+	}
+	if ( failTime < 0 ) {
+		for ( i = 0; i < par->EN_GPSZ && failTime < 0; i++ ) {
+			if ( mp1[i]->getMemberNode()->bFailed ) {
+				failTime = par->getcurrtime();
+			}
+		}
+		if ( failTime < 0 ) {
+			return;
+		}
 	}
 
-	return SUCCESS;
+	for ( i = 0; i < par->EN_GPSZ && !listed; i++ ) {
+		Member *node = mp1[i]->getMemberNode();
+		if ( node->bFailed ) {
+			continue;
+		}
+		for ( j = 0; j < (int)node->memberList.size() && !listed; j++ ) {
+			// Node ids are handed out from 1 in the order of mp1
+			int id = node->memberList[j].id;
+			listed = ( id >= 1 && id <= par->EN_GPSZ && mp1[id - 1]->getMemberNode()->bFailed );
+		}
+	}
+	if ( !listed ) {
+		detectTime = par->getcurrtime();
+	}
+}
+
+/**
+ * FUNCTION NAME: trackBootstrap
+ *
+ * DESCRIPTION: Join benchmark. Notes the first tick by which every node has started, is in the group
+ * 				and has all the others in its membership list
+ */
+void Application::trackBootstrap() {
+	int i;
+
+	if ( bootstrapTime >= 0 || par->getcurrtime() <= (int)(par->STEP_RATE * (par->EN_GPSZ - 1)) ) {
+		return;
+	}
+	for ( i = 0; i < par->EN_GPSZ; i++ ) {
+		Member *node = mp1[i]->getMemberNode();
+		if ( !par->isLocal(i + 1) ) {
+			continue;
+		}
+		if ( node->bFailed ) {
+			return;
+		}
+		if ( !node->inGroup || (int)node->memberList.size() < par->EN_GPSZ - 1 ) {
+			return;
+		}
+	}
+	bootstrapTime = par->getcurrtime();
+}
+
+/**
+ * FUNCTION NAME: logMembershipStats
+ *
+ * DESCRIPTION: Writes the membership traffic per node per tick and the failure detection time to stats.log
+ */
+void Application::logMembershipStats() {
+	en_stat total = en->ENtotal();
+	// In a multi-process run this process reports on the nodes it runs
+	double nodeTicks = (double)par->localNodes() * TOTAL_RUNNING_TIME;
+
+	if ( par->DETECTOR == SWIM_DETECTOR ) {
+		log->LOG(&mp1[0]->getMemberNode()->addr, "#STATSLOG# membership with %d nodes, SWIM probe every %d ticks, %d indirect: %.2f msgs and %.0f bytes per node per tick",
+				par->EN_GPSZ, par->SWIM_PERIOD, par->SWIM_PROBES, total.sent_msgs / nodeTicks, total.sent_bytes / nodeTicks);
+	}
+	else {
+		log->LOG(&mp1[0]->getMemberNode()->addr, "#STATSLOG# membership with %d nodes, fanout %d every %d ticks: %.2f msgs and %.0f bytes per node per tick",
+				par->EN_GPSZ, par->GOSSIP_FANOUT, par->GOSSIP_INTERVAL, total.sent_msgs / nodeTicks, total.sent_bytes / nodeTicks);
+	}
+	if ( bootstrapTime < 0 ) {
+		log->LOG(&mp1[0]->getMemberNode()->addr, "#STATSLOG# bootstrap with %d introducers: the group never reached full membership",
+				par->INTRODUCERS);
+	}
+	else {
+		// Join load: bytes each node sent until the group was complete, the busiest node against the average
+		long busiest = 0, bytes = 0;
+		int busiestId = 0;
+		for ( int id = 1; id <= par->EN_GPSZ; id++ ) {
+			long sent = 0;
+			for ( int t = 0; t <= bootstrapTime; t++ ) {
+				sent += en->stat(id, t).sent_bytes;
+			}
+			bytes += sent;
+			if ( sent > busiest ) {
+				busiest = sent;
+				busiestId = id;
+			}
+		}
+		log->LOG(&mp1[0]->getMemberNode()->addr, "#STATSLOG# bootstrap with %d introducers: full membership at tick %d, busiest node %d sent %ld bytes, %.0f per node on average",
+				par->INTRODUCERS, bootstrapTime, busiestId, busiest, (double)bytes / par->localNodes());
+	}
+	if ( failTime < 0 ) {
+		log->LOG(&mp1[0]->getMemberNode()->addr, "#STATSLOG# failure detection: no node failed");
+	}
+	else if ( detectTime < 0 ) {
+		log->LOG(&mp1[0]->getMemberNode()->addr, "#STATSLOG# failure detection: failure at %d not detected by every node", failTime);
+	}
+	else {
+		log->LOG(&mp1[0]->getMemberNode()->addr, "#STATSLOG# failure detection: failure at %d removed by every node after %d ticks",
+				failTime, detectTime - failTime);
+	}
+}
+
+/**
+ * FUNCTION NAME: logZoneStats
+ *
+ * DESCRIPTION: Writes how many of the bytes net carried stayed within a zone and how many crossed zones
+ */
+void Application::logZoneStats(const char *protocol, EmulNet *net) {
+	long total = net->ENtotal().sent_bytes;
+	long cross = net->ENcrossZone();
+	log->LOG(&mp1[0]->getMemberNode()->addr, "#STATSLOG# %s traffic over %d zones: %ld bytes intra-zone, %ld bytes cross-zone, ratio %.2f",
+			protocol, par->ZONES, total - cross, cross, cross ? (double)(total - cross) / cross : 0.0);
+}
+
+/**
+ * FUNCTION NAME: logPacketStats
+ *
+ * DESCRIPTION: Writes the packets per tick both networks carried from the inserts to the end of the run
+ */
+void Application::logPacketStats() {
+	long membership = 0, kv = 0;
+	int ticks = TOTAL_RUNNING_TIME - INSERT_TIME;
+	for ( int id = 1; id <= par->EN_GPSZ; id++ ) {
+		for ( int t = INSERT_TIME; t < TOTAL_RUNNING_TIME; t++ ) {
+			membership += en->stat(id, t).sent_msgs;
+			kv += en1->stat(id, t).sent_msgs;
+		}
+	}
+	log->LOG(&mp1[0]->getMemberNode()->addr, "#STATSLOG# packets per tick with %d writes per tick, piggyback %d: membership %.1f, kv store %.1f, total %.1f",
+			par->WRITE_LOAD, par->PIGGYBACK, (double)membership / ticks, (double)kv / ticks, (double)(membership + kv) / ticks);
+}
+
+/**
+ * FUNCTION NAME: logTickStats
+ *
+ * DESCRIPTION: Tick time benchmark. Writes the average and worst wall clock time per tick,
+ * 				and the share of it spent receiving from EmulNet, to stats.log
+ */
+void Application::logTickStats() {
+	log->LOG(&mp1[0]->getMemberNode()->addr, "#STATSLOG# tick time over %d ticks with %d nodes: avg %.1f us, max %.1f us, recv avg %.1f us",
+			TOTAL_RUNNING_TIME, par->EN_GPSZ, tickTimeTotal / TOTAL_RUNNING_TIME, tickTimeMax, recvTimeTotal / TOTAL_RUNNING_TIME);
 }
 
 /**
@@ -143,17 +364,24 @@ void Application::mp1Run() {
 	for( i = 0; i <= par->EN_GPSZ-1; i++) {
 
 		/*
-		 * Receive messages from the network and queue them in the membership protocol queue
+		 * Receive messages from the network and queue them in the membership protocol queue.
+		 * Failed nodes are visited too: their recvLoop throws the messages away.
+		 * The nodes of the other processes of a multi-process run are run there
 		 */
-		if( par->getcurrtime() > (int)(par->STEP_RATE*i) && !(mp1[i]->getMemberNode()->bFailed) ) {
+		if( par->getcurrtime() > (int)(par->STEP_RATE*i) && par->isLocal(i + 1) ) {
 			// Receive messages from the network and queue them
+			double recvStart = nowUsec();
 			mp1[i]->recvLoop();
+			recvTimeTotal += nowUsec() - recvStart;
 		}
 
 	}
 
 	// For all the nodes in the system
 	for( i = par->EN_GPSZ - 1; i >= 0; i-- ) {
+		if ( !par->isLocal(i + 1) ) {
+			continue;
+		}
 
 		/*
 		 * Introduce nodes into the distributed system
@@ -199,13 +427,15 @@ void Application::mp2Run() {
 		 * 1) Update the ring
 		 * 2) Receive messages from the network and queue them in the KV store queue
 		 */
-		if ( par->getcurrtime() > (int)(par->STEP_RATE*i) && !mp2[i]->getMemberNode()->bFailed ) {
-			if ( mp2[i]->getMemberNode()->inited && mp2[i]->getMemberNode()->inGroup ) {
+		if ( par->getcurrtime() > (int)(par->STEP_RATE*i) ) {
+			if ( !mp2[i]->getMemberNode()->bFailed && mp2[i]->getMemberNode()->inited && mp2[i]->getMemberNode()->inGroup ) {
 				// Step 1
 				mp2[i]->updateRing();
 			}
 			// Step 2
+			double recvStart = nowUsec();
 			mp2[i]->recvLoop();
+			recvTimeTotal += nowUsec() - recvStart;
 		}
 	}
 
@@ -224,6 +454,9 @@ void Application::mp2Run() {
 	if ( par->getcurrtime() == INSERT_TIME ) {
 		insertTestKVPairs();
 	}
+	else if ( par->WRITE_LOAD > 0 && par->getcurrtime() > INSERT_TIME ) {
+		writeLoad();
+	}
 
 	/**
 	 * Test CRUD operations
@@ -341,20 +574,21 @@ void Application::fail() {
 		par->dropmsg = 1;
 	}
 
-	if( par->SINGLE_FAILURE && par->getcurrtime() == 100 ) {
-		removed = (rand() % par->EN_GPSZ);
+	// Drawn from the run's seed, so every process of a multi-process run fails the same nodes
+	if( par->SINGLE_FAILURE && par->getcurrtime() == par->FAIL_TIME ) {
+		removed = (rand_r(&par->SEED) % par->EN_GPSZ);
 		#ifdef DEBUGLOG
 		log->LOG(&mp1[removed]->getMemberNode()->addr, "Node failed at time=%d", par->getcurrtime());
 		#endif
-		mp1[removed]->getMemberNode()->bFailed = true;
+		failNode(removed);
 	}
-	else if( par->getcurrtime() == 100 ) {
-		removed = rand() % par->EN_GPSZ/2;
+	else if( par->getcurrtime() == par->FAIL_TIME ) {
+		removed = rand_r(&par->SEED) % par->EN_GPSZ/2;
 		for ( i = removed; i < removed + par->EN_GPSZ/2; i++ ) {
 			#ifdef DEBUGLOG
 			log->LOG(&mp1[i]->getMemberNode()->addr, "Node failed at time = %d", par->getcurrtime());
 			#endif
-			mp1[i]->getMemberNode()->bFailed = true;
+			failNode(i);
 		}
 	}
 
@@ -364,6 +598,22 @@ void Application::fail() {
 
 }
 
+/**
+ * FUNCTION NAME: failNode
+ *
+ * DESCRIPTION: Take node i down. It crashes, or with LEAVE set it leaves gracefully:
+ * 				its keys go to their next replicas and the group is told it left.
+ */
+void Application::failNode(int i) {
+	if ( par->LEAVE ) {
+		if ( par->CRUDTEST != MEMBERSHIP_TEST ) {
+			mp2[i]->handoff();
+		}
+		mp1[i]->finishUpThisNode();
+	}
+	mp1[i]->getMemberNode()->bFailed = true;
+}
+
 /**
  * FUNCTION NAME: getjoinaddr
  *
@@ -439,6 +689,22 @@ void Application::insertTestKVPairs() {
 	cout<<endl<<"Sent " <<testKVPairs.size() <<" create messages to the ring"<<endl;
 }
 
+/**
+ * FUNCTION NAME: writeLoad
+ *
+ * DESCRIPTION: Write heavy load for benchmarks: WRITE_LOAD updates of random test keys, each from a random live node
+ */
+void Application::writeLoad() {
+	if ( testKVPairs.empty() ) {
+		return;
+	}
+	for ( int i = 0; i < par->WRITE_LOAD; i++ ) {
+		map<string, string>::iterator it = testKVPairs.begin();
+		advance(it, rand() % testKVPairs.size());
+		mp2[findARandomNodeThatIsAlive()]->clientUpdate(it->first, it->second);
+	}
+}
+
 /**
  * FUNCTION NAME: deleteTest
  *
@@ -544,8 +810,7 @@ void Application::readTest() {
 		}
 		if ( failedOneNode ) {
 			log->LOG(&mp2[nodeToFail]->getMemberNode()->addr, "Node failed at time=%d", par->getcurrtime());
-			mp2[nodeToFail]->getMemberNode()->bFailed = true;
-			mp1[nodeToFail]->getMemberNode()->bFailed = true;
+			failNode(nodeToFail);
 			cout<<endl<<"Failed a replica node"<<endl;
 		}
 		else {
@@ -618,8 +883,7 @@ void Application::readTest() {
 				for ( int i = 0; i < nodesToFail.size(); i++ ) {
 					// Fail a node
 					log->LOG(&mp2[nodesToFail.at(i)]->getMemberNode()->addr, "Node failed at time=%d", par->getcurrtime());
-					mp2[nodesToFail.at(i)]->getMemberNode()->bFailed = true;
-					mp1[nodesToFail.at(i)]->getMemberNode()->bFailed = true;
+					failNode(nodesToFail.at(i));
 					cout<<endl<<"Failed a replica node"<<endl;
 				}
 			}
@@ -673,8 +937,7 @@ void Application::readTest() {
 					 mp2[i]->getMemberNode()->addr.getAddress() != replicas.at(TERTIARY).getAddress()->getAddress() ) {
 					// Step 4.c Fail a non-replica node
 					log->LOG(&mp2[i]->getMemberNode()->addr, "Node failed at time=%d", par->getcurrtime());
-					mp2[i]->getMemberNode()->bFailed = true;
-					mp1[i]->getMemberNode()->bFailed = true;
+					failNode(i);
 					failedOneNode = true;
 					cout<<endl<<"Failed a non-replica node"<<endl;
 					break;
@@ -789,8 +1052,7 @@ void Application::updateTest() {
 		}
 		if ( failedOneNode ) {
 			log->LOG(&mp2[nodeToFail]->getMemberNode()->addr, "Node failed at time=%d", par->getcurrtime());
-			mp2[nodeToFail]->getMemberNode()->bFailed = true;
-			mp1[nodeToFail]->getMemberNode()->bFailed = true;
+			failNode(nodeToFail);
 			cout<<endl<<"Failed a replica node"<<endl;
 		}
 		else {
@@ -861,8 +1123,7 @@ void Application::updateTest() {
 				for ( int i = 0; i < nodesToFail.size(); i++ ) {
 					// Fail a node
 					log->LOG(&mp2[nodesToFail.at(i)]->getMemberNode()->addr, "Node failed at time=%d", par->getcurrtime());
-					mp2[nodesToFail.at(i)]->getMemberNode()->bFailed = true;
-					mp1[nodesToFail.at(i)]->getMemberNode()->bFailed = true;
+					failNode(nodesToFail.at(i));
 					cout<<endl<<"Failed a replica node"<<endl;
 				}
 			}
@@ -915,8 +1176,7 @@ void Application::updateTest() {
 					 mp2[i]->getMemberNode()->addr.getAddress() != replicas.at(TERTIARY).getAddress()->getAddress() ) {
 					// Step 4.c Fail a non-replica node
 					log->LOG(&mp2[i]->getMemberNode()->addr, "Node failed at time=%d", par->getcurrtime());
-					mp2[i]->getMemberNode()->bFailed = true;
-					mp1[i]->getMemberNode()->bFailed = true;
+					failNode(i);
 					failedOneNode = true;
 					cout<<endl<<"Failed a non-replica node"<<endl;
 					break;
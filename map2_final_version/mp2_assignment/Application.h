@@ -13,6 +13,8 @@
 #include "Params.h"
 #include "Member.h"
 #include "EmulNet.h"
+#include "UdpNet.h"
+#include "ShmNet.h"
 #include "Queue.h"
 #include "MP2Node.h"
 #include "Node.h"
@@ -58,6 +60,15 @@ private:
 	MP2Node **mp2;
 	Params *par;
 	map<string, string> testKVPairs;
+	// Wall clock spent per tick (microseconds), used for the tick time benchmark
+	double tickTimeTotal;
+	double tickTimeMax;
+	double recvTimeTotal;
+	// Failure detection benchmark: first tick with a failed node, and the tick no live node lists one any more
+	int failTime;
+	int detectTime;
+	// Join benchmark: first tick every node is in the group and lists all the others
+	int bootstrapTime;
 public:
 	Application(char *);
 	virtual ~Application();
@@ -67,11 +78,19 @@ public:
 	void mp1Run();
 	void mp2Run();
 	void fail();
+	void failNode(int i);
 	void insertTestKVPairs();
 	int findARandomNodeThatIsAlive();
 	void deleteTest();
 	void readTest();
 	void updateTest();
+	void writeLoad();
+	void logTickStats();
+	void trackDetection();
+	void trackBootstrap();
+	void logMembershipStats();
+	void logZoneStats(const char *protocol, EmulNet *net);
+	void logPacketStats();
 };
 
 #endif /* _APPLICATION_H__ */
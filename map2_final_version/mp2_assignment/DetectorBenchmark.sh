@@ -0,0 +1,39 @@
+#!/bin/bash
+
+#################################################
+# FILE NAME: DetectorBenchmark.sh
+#
+# DESCRIPTION: Compares the MP1 failure detectors on the message drop test cases.
+#              For every case and detector it prints the false removals, removals of
+#              nodes that never failed, and the detection latency from stats.log.
+#              overload50.conf overloads five nodes for 100 ticks and fails none.
+#              LOCAL_HEALTH in the environment is passed on to every case.
+#
+# RUN PROCEDURE:
+# $ chmod +x DetectorBenchmark.sh
+# $ [LOCAL_HEALTH=8] ./DetectorBenchmark.sh [detector ...]
+#################################################
+
+CASES="testcases/msgdropsinglefailure.conf testcases/msgdrop100.conf testcases/overload50.conf"
+DETECTORS=${@:-"HEARTBEAT PHI SWIM"}
+CONF=testcases/detector.conf
+
+make > /dev/null
+for conf in $CASES
+do
+	for detector in $DETECTORS
+	do
+		cp $conf $CONF
+		echo "DETECTOR: $detector" >> $CONF
+		if [ -n "$LOCAL_HEALTH" ]; then
+			echo "LOCAL_HEALTH: $LOCAL_HEALTH" >> $CONF
+		fi
+		./Application $CONF > /dev/null
+		grep "Node failed at time" dbg.log | awk '{print "Node "$1" removed"}' | sort -u > failed.tmp
+		total=`grep removed dbg.log | wc -l`
+		false=`grep removed dbg.log | grep -v -F -f failed.tmp | wc -l`
+		detection=`grep "#STATSLOG# failure detection" stats.log | sed 's/.*failure detection: //'`
+		echo "$conf $detector: $false false removals of $total, $detection"
+	done
+done
+rm -f $CONF failed.tmp
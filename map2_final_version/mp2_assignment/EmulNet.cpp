@@ -9,60 +9,76 @@
 /**
  * Constructor
  */
-EmulNet::EmulNet(Params *p)
+EmulNet::EmulNet(Params *p, int instance)
 {
 	//trace.funcEntry("EmulNet::EmulNet");
-	int i,j;
 	par = p;
+	this->instance = instance;
 	emulnet.setNextId(1);
 	emulnet.settCurrBuffSize(0);
 	enInited=0;
-	for ( i = 0; i < MAX_NODES; i++ ) {
-		for ( j = 0; j < MAX_TIME; j++ ) {
-			sent_msgs[i][j] = 0;
-			recv_msgs[i][j] = 0;
-		}
-	}
+	delayTotal = 0;
+	delayCount = 0;
+	delayMax = 0;
+	bufferLimit = min(ENBUFFSIZE, par->EN_BUFF_MAX);
+	bufferGrowths = 0;
+	dropRandom = 0;
+	dropOversize = 0;
+	dropOverflow = 0;
+	dropCredit = 0;
+	dropFailed = 0;
+	crossZoneBytes = 0;
 	//trace.funcExit("EmulNet::EmulNet", SUCCESS);
 }
 
 /**
- * Copy constructor
+ * Destructor
  */
-EmulNet::EmulNet(EmulNet &anotherEmulNet) {
-	int i, j;
-	this->par = anotherEmulNet.par;
-	this->enInited = anotherEmulNet.enInited;
-	for ( i = 0; i < MAX_NODES; i++ ) {
-		for ( j = 0; j < MAX_TIME; j++ ) {
-			this->sent_msgs[i][j] = anotherEmulNet.sent_msgs[i][j];
-			this->recv_msgs[i][j] = anotherEmulNet.recv_msgs[i][j];
-		}
+EmulNet::~EmulNet() {}
+
+/**
+ * FUNCTION NAME: stat
+ *
+ * DESCRIPTION: Traffic counters of node at time, growing the table as needed
+ */
+en_stat &EmulNet::stat(int node, int time) {
+	if ( node >= (int)stats.size() ) {
+		stats.resize(node + 1);
+	}
+	vector<en_stat> &row = stats[node];
+	if ( time >= (int)row.size() ) {
+		en_stat zero = {0, 0, 0, 0};
+		row.resize(time + 1, zero);
 	}
-	this->emulnet = anotherEmulNet.emulnet;
+	return row[time];
 }
 
 /**
- * Assignment operator overloading
+ * FUNCTION NAME: ENtotal
+ *
+ * DESCRIPTION: Traffic of all nodes over the whole run so far
  */
-EmulNet& EmulNet::operator =(EmulNet &anotherEmulNet) {
-	int i, j;
-	this->par = anotherEmulNet.par;
-	this->enInited = anotherEmulNet.enInited;
-	for ( i = 0; i < MAX_NODES; i++ ) {
-		for ( j = 0; j < MAX_TIME; j++ ) {
-			this->sent_msgs[i][j] = anotherEmulNet.sent_msgs[i][j];
-			this->recv_msgs[i][j] = anotherEmulNet.recv_msgs[i][j];
+en_stat EmulNet::ENtotal() {
+	en_stat total = {0, 0, 0, 0};
+	for ( int i = 0; i < (int)stats.size(); i++ ) {
+		for ( int j = 0; j < (int)stats[i].size(); j++ ) {
+			total.sent_msgs += stats[i][j].sent_msgs;
+			total.recv_msgs += stats[i][j].recv_msgs;
+			total.sent_bytes += stats[i][j].sent_bytes;
+			total.recv_bytes += stats[i][j].recv_bytes;
 		}
 	}
-	this->emulnet = anotherEmulNet.emulnet;
-	return *this;
+	return total;
 }
 
 /**
- * Destructor
+ * FUNCTION NAME: ENcrossZone
+ *
+ * DESCRIPTION: Bytes sent so far from one zone to another
  */
-EmulNet::~EmulNet() {}
+long EmulNet::ENcrossZone() {
+	return crossZoneBytes;
+}
 
 /**
  * FUNCTION NAME: ENinit
@@ -73,50 +89,206 @@ void *EmulNet::ENinit(Address *myaddr, short port) {
 	// Initialize data structures for this member
 	*(int *)(myaddr->addr) = emulnet.nextid++;
     *(short *)(&myaddr->addr[4]) = 0;
+	// Make room for this node's mailbox
+	emulnet.mailbox.resize(emulnet.nextid);
 	return myaddr;
 }
 
 /**
- * FUNCTION NAME: ENsend
+ * FUNCTION NAME: ENalloc
  *
- * DESCRIPTION: EmulNet send function
+ * DESCRIPTION: Allocate a reference counted payload of size bytes. The caller holds the
+ * 				first reference and must give it back with ENrelease once it is done sending.
+ * 				dtor, if given, is run on the payload right before it is freed.
  *
  * RETURNS:
- * size
+ * pointer to the payload
  */
-int EmulNet::ENsend(Address *myaddr, Address *toaddr, char *data, int size) {
-	en_msg *em;
-	static char temp[2048];
-	int sendmsg = rand() % 100;
+char *EmulNet::ENalloc(int size, void (*dtor)(char *)) {
+	en_buf *buf = (en_buf *)pool.alloc(sizeof(en_buf) + size);
+	buf->refcount = 1;
+	buf->size = size;
+	buf->dtor = dtor;
+	return (char *)(buf + 1);
+}
 
-	if( (emulnet.currbuffsize >= ENBUFFSIZE) || (size + (int)sizeof(en_msg) >= par->MAX_MSG_SIZE) || (par->dropmsg && sendmsg < (int) (par->MSG_DROP_PROB * 100)) ) {
-		return 0;
+/**
+ * FUNCTION NAME: deliveryTime
+ *
+ * DESCRIPTION: Schedule a message of size bytes from src to dst.
+ * 				With a BANDWIDTH cap the message first waits until src has sent what it queued before,
+ * 				then spends the link delay plus a random 0..jitter ticks in flight.
+ *
+ * RETURNS:
+ * tick from which ENrecv may deliver it
+ */
+int EmulNet::deliveryTime(int src, int dst, int size) {
+	int now = par->getcurrtime();
+	int sendTime = now;
+
+	if ( par->BANDWIDTH > 0 ) {
+		if ( src >= (int)txTick.size() ) {
+			txTick.resize(src + 1, 0);
+			txBytes.resize(src + 1, 0);
+		}
+		if ( txTick[src] < now ) {
+			txTick[src] = now;
+			txBytes[src] = 0;
+		}
+		txBytes[src] += size;
+		while ( txBytes[src] > par->BANDWIDTH ) {
+			txTick[src]++;
+			txBytes[src] -= par->BANDWIDTH;
+		}
+		sendTime = txTick[src];
 	}
 
-	em = (en_msg *)malloc(sizeof(en_msg) + size);
-	em->size = size;
+	LinkModel link = par->getLinkModel(src, dst);
+	int deliverAt = sendTime + link.delay;
+	if ( link.jitter > 0 ) {
+		deliverAt += rand() % (link.jitter + 1);
+		// Jitter must not reorder a link
+		int &last = linkClock[(long)src * (MAX_NODES + 1) + dst];
+		deliverAt = max(deliverAt, last);
+		last = deliverAt;
+	}
+	return deliverAt;
+}
 
-	memcpy(&(em->from.addr), &(myaddr->addr), sizeof(em->from.addr));
-	memcpy(&(em->to.addr), &(toaddr->addr), sizeof(em->from.addr));
-	memcpy(em + 1, data, size);
+/**
+ * FUNCTION NAME: dropMessage
+ *
+ * DESCRIPTION: Decide whether a message of size bytes is lost: it is too large, or the
+ * 				test case drops messages and it loses the draw against MSG_DROP_PROB
+ */
+int EmulNet::dropMessage(int size) {
+	int sendmsg = rand() % 100;
+	if ( size + (int)sizeof(en_msg) >= par->MAX_MSG_SIZE ) {
+		dropOversize++;
+		return 1;
+	}
+	if ( par->dropmsg && sendmsg < (int) (par->MSG_DROP_PROB * 100) ) {
+		dropRandom++;
+		return 1;
+	}
+	return 0;
+}
 
-	emulnet.buff[emulnet.currbuffsize++] = em;
+/**
+ * FUNCTION NAME: inflightOf
+ *
+ * DESCRIPTION: Undelivered message count of sender src, growing the table as needed
+ */
+int &EmulNet::inflightOf(int src) {
+	if ( src >= (int)inflight.size() ) {
+		inflight.resize(src + 1, 0);
+	}
+	return inflight[src];
+}
+
+/**
+ * FUNCTION NAME: ENcredits
+ *
+ * DESCRIPTION: How many more messages the node may send before ENsendBuffer refuses them.
+ * 				A sender spends one credit per message and gets it back on delivery.
+ * 				Transports that do not queue in EmulNet never run out.
+ */
+int EmulNet::ENcredits(Address *myaddr) {
+	int src = *(int *)(myaddr->addr);
+	if ( src < 0 ) {
+		return 0;
+	}
+	return par->EN_CREDITS - inflightOf(src);
+}
+
+/**
+ * FUNCTION NAME: ENsendBuffer
+ *
+ * DESCRIPTION: EmulNet send function for a payload obtained from ENalloc.
+ * 				The message shares the payload with the sender instead of copying it.
+ *
+ * RETURNS:
+ * size
+ */
+int EmulNet::ENsendBuffer(Address *myaddr, Address *toaddr, char *buffer) {
+	en_buf *buf = (en_buf *)buffer - 1;
+	int size = buf->size;
+	en_msg em;
+	static char temp[2048];
 
 	int src = *(int *)(myaddr->addr);
+	int dst = *(int *)(toaddr->addr);
 	int time = par->getcurrtime();
 
-	assert(src <= MAX_NODES);
-	assert(time < MAX_TIME);
+	assert(src >= 0 && src <= MAX_NODES);
+	assert(dst >= 0 && dst <= MAX_NODES);
 
-	sent_msgs[src][time]++;
+	if( dropMessage(size) ) {
+		return 0;
+	}
+	if ( inflightOf(src) >= par->EN_CREDITS ) {
+		dropCredit++;
+		return 0;
+	}
+	if ( emulnet.currbuffsize >= bufferLimit ) {
+		if ( bufferLimit >= par->EN_BUFF_MAX ) {
+			dropOverflow++;
+			return 0;
+		}
+		bufferLimit = min(2 * bufferLimit, par->EN_BUFF_MAX);
+		bufferGrowths++;
+	}
+
+	em.size = size;
+	em.from = *myaddr;
+	em.to = *toaddr;
+	em.buf = buf;
+	buf->refcount++;
+	inflightOf(src)++;
+
+	em.sentAt = time;
+	em.deliverAt = deliveryTime(src, dst, size);
+
+	// Index the message by its destination so that ENrecv only looks at its own mailbox
+	if ( dst >= (int)emulnet.mailbox.size() ) {
+		emulnet.mailbox.resize(dst + 1);
+	}
+	emulnet.mailbox[dst].push_back(em);
+	emulnet.currbuffsize++;
+
+	en_stat &sent = stat(src, time);
+	sent.sent_msgs++;
+	sent.sent_bytes += size;
+	if ( par->getZone(src) != par->getZone(dst) ) {
+		crossZoneBytes += size;
+	}
 
 	#ifdef DEBUGLOG
-		sprintf(temp, "Sending 4+%d B msg type %d to %d.%d.%d.%d:%d ", size-4, *(int *)data, toaddr->addr[0], toaddr->addr[1], toaddr->addr[2], toaddr->addr[3], *(short *)&toaddr->addr[4]);
+		sprintf(temp, "Sending 4+%d B msg type %d to %d.%d.%d.%d:%d ", size-4, *(int *)buffer, toaddr->addr[0], toaddr->addr[1], toaddr->addr[2], toaddr->addr[3], *(short *)&toaddr->addr[4]);
 	#endif
 
 	return size;
 }
 
+/**
+ * FUNCTION NAME: ENmulticast
+ *
+ * DESCRIPTION: Send one payload from ENalloc to every address in toaddrs.
+ * 				All the messages share the payload; drops and traffic stats are still per destination.
+ *
+ * RETURNS:
+ * number of destinations the message was sent to
+ */
+int EmulNet::ENmulticast(Address *myaddr, vector<Address> &toaddrs, char *buffer) {
+	int sent = 0;
+	for ( int i = 0; i < (int)toaddrs.size(); i++ ) {
+		if ( ENsendBuffer(myaddr, &toaddrs[i], buffer) > 0 ) {
+			sent++;
+		}
+	}
+	return sent;
+}
+
 /**
  * FUNCTION NAME: ENsend
  *
@@ -125,54 +297,136 @@ int EmulNet::ENsend(Address *myaddr, Address *toaddr, char *data, int size) {
  * RETURNS:
  * size
  */
-int EmulNet::ENsend(Address *myaddr, Address *toaddr, string data) {
-	char * str = (char *) malloc(data.length() * sizeof(char));
-	memcpy(str, data.c_str(), data.size());
-	int ret = this->ENsend(myaddr, toaddr, str, (data.length() * sizeof(char)));
-	free(str);
+int EmulNet::ENsend(Address *myaddr, Address *toaddr, char *data, int size) {
+	char *buffer = ENalloc(size);
+	memcpy(buffer, data, size);
+	int ret = ENsendBuffer(myaddr, toaddr, buffer);
+	ENrelease(buffer);
 	return ret;
 }
 
+/**
+ * FUNCTION NAME: ENsend
+ *
+ * DESCRIPTION: EmulNet send function
+ *
+ * RETURNS:
+ * size
+ */
+int EmulNet::ENsend(Address *myaddr, Address *toaddr, const string &data) {
+	return ENsend(myaddr, toaddr, (char *)data.data(), (int)data.size());
+}
+
 /**
  * FUNCTION NAME: ENrecv
  *
- * DESCRIPTION: EmulNet receive function
+ * DESCRIPTION: EmulNet receive function. The payload is handed to enq in place;
+ * 				whoever consumes it must give it back with ENrelease.
  *
  * RETURN:
  * 0
  */
 int EmulNet::ENrecv(Address *myaddr, int (* enq)(void *, char *, int), struct timeval *t, int times, void *queue){
 	// times is always assumed to be 1
-	int i;
-	char* tmp;
-	int sz;
-	en_msg *emsg;
+	int dst = *(int *)(myaddr->addr);
+	int time = par->getcurrtime();
 
-	for( i = emulnet.currbuffsize - 1; i >= 0; i-- ) {
-		emsg = emulnet.buff[i];
+	assert(dst <= MAX_NODES);
 
-		if ( 0 == strcmp(emsg->to.addr, myaddr->addr) ) {
-			sz = emsg->size;
-			tmp = (char *) malloc(sz * sizeof(char));
-			memcpy(tmp, (char *)(emsg+1), sz);
+	if ( dst < 0 || dst >= (int)emulnet.mailbox.size() ) {
+		return 0;
+	}
 
-			emulnet.buff[i] = emulnet.buff[emulnet.currbuffsize-1];
-			emulnet.currbuffsize--;
+	// Drain the messages of this node's mailbox that are due, in arrival order.
+	// Messages still in flight are rotated to the back, which keeps their order.
+	deque<en_msg> &box = emulnet.mailbox[dst];
+	size_t pending = box.size();
+	while ( pending-- > 0 ) {
+		en_msg emsg = box.front();
+		box.pop_front();
+		if ( emsg.deliverAt > time ) {
+			box.push_back(emsg);
+			continue;
+		}
+		emulnet.currbuffsize--;
+		inflightOf(*(int *)(emsg.from.addr))--;
 
-			(*enq)(queue, (char *)tmp, sz);
+		delayTotal += time - emsg.sentAt;
+		delayCount++;
+		delayMax = max(delayMax, time - emsg.sentAt);
 
-			free(emsg);
+		(*enq)(queue, (char *)(emsg.buf + 1), emsg.size);
 
-			int dst = *(int *)(myaddr->addr);
-			int time = par->getcurrtime();
+		en_stat &recv = stat(dst, time);
+		recv.recv_msgs++;
+		recv.recv_bytes += emsg.size;
+	}
 
-			assert(dst <= MAX_NODES);
-			assert(time < MAX_TIME);
+	return 0;
+}
 
-			recv_msgs[dst][time]++;
-		}
+/**
+ * FUNCTION NAME: ENpurge
+ *
+ * DESCRIPTION: Throw away everything queued for a failed node. Nobody will ever ENrecv those
+ * 				messages, so this is what gives their senders the EN_CREDITS back.
+ *
+ * RETURN:
+ * number of messages dropped
+ */
+int EmulNet::ENpurge(Address *myaddr) {
+	int dst = *(int *)(myaddr->addr);
+
+	if ( dst < 0 || dst >= (int)emulnet.mailbox.size() ) {
+		return 0;
+	}
+
+	deque<en_msg> &box = emulnet.mailbox[dst];
+	int purged = (int)box.size();
+	while ( !box.empty() ) {
+		en_msg emsg = box.front();
+		box.pop_front();
+		emulnet.currbuffsize--;
+		inflightOf(*(int *)(emsg.from.addr))--;
+		ENrelease((char *)(emsg.buf + 1));
+	}
+	dropFailed += purged;
+
+	return purged;
+}
+
+/**
+ * FUNCTION NAME: ENretain
+ *
+ * DESCRIPTION: Take one more reference to a payload from ENalloc or ENrecv, given back with ENrelease
+ */
+void EmulNet::ENretain(char *buffer) {
+	((en_buf *)buffer - 1)->refcount++;
+}
+
+/**
+ * FUNCTION NAME: ENrelease
+ *
+ * DESCRIPTION: Drop one reference to a payload from ENalloc or ENrecv, freeing it with the last one
+ */
+void EmulNet::ENrelease(char *buffer) {
+	en_buf *buf = (en_buf *)buffer - 1;
+	if ( --buf->refcount > 0 ) {
+		return;
+	}
+	if ( buf->dtor ) {
+		buf->dtor(buffer);
 	}
+	pool.release(buf, sizeof(en_buf) + buf->size);
+}
 
+/**
+ * FUNCTION NAME: ENflush
+ *
+ * DESCRIPTION: Push out sends a transport buffered during the tick.
+ * 				The emulated network queues messages in ENsendBuffer already, so there is nothing to do.
+ */
+int EmulNet::ENflush() {
 	return 0;
 }
 
@@ -185,36 +439,57 @@ int EmulNet::ENcleanup() {
 	emulnet.nextid=0;
 	int i, j;
 	int sent_total, recv_total;
+	long sent_bytes, recv_bytes;
 
-	FILE* file = fopen("msgcount.log", "w+");
+	// Both networks of a run report to the one file, the first starts it afresh
+	FILE* file = fopen("msgcount.log", instance == 0 ? "w" : "a");
+	fprintf(file, "network %d\n", instance);
 
-	while(emulnet.currbuffsize > 0) {
-		free(emulnet.buff[--emulnet.currbuffsize]);
+	for ( i = 0; i < (int)emulnet.mailbox.size(); i++ ) {
+		while ( !emulnet.mailbox[i].empty() ) {
+			ENrelease((char *)(emulnet.mailbox[i].front().buf + 1));
+			emulnet.mailbox[i].pop_front();
+		}
 	}
+	emulnet.currbuffsize = 0;
+	inflight.clear();
 
 	for ( i = 1; i <= par->EN_GPSZ; i++ ) {
 		fprintf(file, "node %3d ", i);
 		sent_total = 0;
 		recv_total = 0;
+		sent_bytes = 0;
+		recv_bytes = 0;
 
 		for (j = 0; j < par->getcurrtime(); j++) {
+			en_stat &cell = stat(i, j);
 
-			sent_total += sent_msgs[i][j];
-			recv_total += recv_msgs[i][j];
+			sent_total += cell.sent_msgs;
+			recv_total += cell.recv_msgs;
+			sent_bytes += cell.sent_bytes;
+			recv_bytes += cell.recv_bytes;
 			if (i != 67) {
-				fprintf(file, " (%4d, %4d)", sent_msgs[i][j], recv_msgs[i][j]);
+				fprintf(file, " (%4d, %4d)", cell.sent_msgs, cell.recv_msgs);
 				if (j % 10 == 9) {
 					fprintf(file, "\n         ");
 				}
 			}
 			else {
-				fprintf(file, "special %4d %4d %4d\n", j, sent_msgs[i][j], recv_msgs[i][j]);
+				fprintf(file, "special %4d %4d %4d\n", j, cell.sent_msgs, cell.recv_msgs);
 			}
 		}
 		fprintf(file, "\n");
-		fprintf(file, "node %3d sent_total %6u  recv_total %6u\n\n", i, sent_total, recv_total);
+		fprintf(file, "node %3d sent_total %6u  recv_total %6u\n", i, sent_total, recv_total);
+		fprintf(file, "node %3d sent_bytes %8ld  recv_bytes %8ld\n\n", i, sent_bytes, recv_bytes);
 	}
 
+	fprintf(file, "delivery delay: avg %.2f ticks  max %d ticks over %ld messages\n",
+			delayCount ? (double)delayTotal / delayCount : 0.0, delayMax, delayCount);
+	fprintf(file, "drops: random %ld  oversize %ld  overflow %ld  no credit %ld  to failed %ld\n",
+			dropRandom, dropOversize, dropOverflow, dropCredit, dropFailed);
+	fprintf(file, "buffer limit %d messages, doubled %d times\n", bufferLimit, bufferGrowths);
+	pool.report(file);
+
 	fclose(file);
 	return 0;
 }
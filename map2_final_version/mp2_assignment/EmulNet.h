@@ -9,45 +9,78 @@
 
 #define MAX_NODES 1000
 #define MAX_TIME 3600
+// Initial bound on in-flight messages, doubled on demand up to EN_BUFF_MAX
 #define ENBUFFSIZE 30000
 
 #include "stdincludes.h"
 #include "Params.h"
 #include "Member.h"
+#include "SlabPool.h"
 
 using namespace std;
 
+/**
+ * Struct Name: en_buf
+ *
+ * Reference counted message payload. The payload bytes follow the struct.
+ * The sender fills it once and every receiver reads it in place.
+ */
+typedef struct en_buf {
+	// Number of holders: the sender until it releases, plus every undelivered or unreleased message
+	int refcount;
+	// Number of payload bytes after the struct
+	int size;
+	// Optional clean up run on the payload when the last reference is released
+	void (*dtor)(char *);
+}en_buf;
+
 /**
  * Struct Name: en_msg
  */
 typedef struct en_msg {
-	// Number of bytes after the class
+	// Number of payload bytes
 	int size;
 	// Source node
 	Address from;
 	// Destination node
 	Address to;
+	// Payload, shared with the sender
+	en_buf *buf;
+	// Tick the message was sent at
+	int sentAt;
+	// First tick at which ENrecv may hand the message out
+	int deliverAt;
 }en_msg;
 
+/**
+ * Struct Name: en_stat
+ *
+ * Traffic of one node during one tick
+ */
+typedef struct en_stat {
+	int sent_msgs;
+	int recv_msgs;
+	long sent_bytes;
+	long recv_bytes;
+}en_stat;
+
 /**
  * Class Name: EM
  */
 class EM {
 public:
 	int nextid;
+	// Total number of in-flight messages across all mailboxes
 	int currbuffsize;
 	int firsteltindex;
-	en_msg* buff[ENBUFFSIZE];
+	// Per-destination FIFO mailboxes, indexed by the node id in Address
+	vector< deque<en_msg> > mailbox;
 	EM() {}
 	EM& operator = (EM &anotherEM) {
 		this->nextid = anotherEM.getNextId();
 		this->currbuffsize = anotherEM.getCurrBuffSize();
 		this->firsteltindex = anotherEM.getFirstEltIndex();
-		int i = this->currbuffsize;
-		while (i > 0) {
-			this->buff[i] = anotherEM.buff[i];
-			i--;
-		}
+		this->mailbox = anotherEM.mailbox;
 		return *this;
 	}
 	int getNextId() {
@@ -74,26 +107,69 @@ public:
 /**
  * CLASS NAME: EmulNet
  *
- * DESCRIPTION: This class defines an emulated network
+ * DESCRIPTION: This class defines an emulated network.
+ * 				ENinit, ENsendBuffer, ENrecv, ENflush and ENcleanup are virtual so that other
+ * 				transports, see UdpNet, can stand in for the in-memory mailboxes.
  */
 class EmulNet
 { 	
-private:
+protected:
 	Params* par;
-	int sent_msgs[MAX_NODES + 1][MAX_TIME];
-	int recv_msgs[MAX_NODES + 1][MAX_TIME];
+	// Which network of the run this is, 0 for membership and 1 for the KV store
+	int instance;
+	// Per node, per tick traffic. Grows with the highest node id and the length of the run
+	vector< vector<en_stat> > stats;
 	int enInited;
 	EM emulnet;
+	// Recycles payload buffers across ticks
+	SlabPool pool;
+	// Bandwidth model: tick each node's outgoing link is busy until, and bytes queued in that tick
+	vector<int> txTick;
+	vector<long> txBytes;
+	// Last delivery tick per link, keeps links FIFO under jitter
+	map<long, int> linkClock;
+	// Ticks spent in flight by delivered messages
+	long delayTotal;
+	long delayCount;
+	int delayMax;
+	// Current bound on in-flight messages and how often it doubled
+	int bufferLimit;
+	int bufferGrowths;
+	// Undelivered messages per sender, charged against its EN_CREDITS
+	vector<int> inflight;
+	// Lost messages by cause
+	long dropRandom;
+	long dropOversize;
+	long dropOverflow;
+	long dropCredit;
+	long dropFailed;
+	// Bytes sent between nodes of different zones
+	long crossZoneBytes;
+	int deliveryTime(int src, int dst, int size);
+	int dropMessage(int size);
+	int &inflightOf(int src);
+	// Queued payloads belong to this instance's pool, so it is not copied
+	EmulNet(EmulNet &anotherEmulNet) = delete;
+	EmulNet& operator = (EmulNet &anotherEmulNet) = delete;
 public:
- 	EmulNet(Params *p);
- 	EmulNet(EmulNet &anotherEmulNet);
- 	EmulNet& operator = (EmulNet &anotherEmulNet);
+ 	EmulNet(Params *p, int instance = 0);
  	virtual ~EmulNet();
-	void *ENinit(Address *myaddr, short port);
-	int ENsend(Address *myaddr, Address *toaddr, string data);
+	en_stat &stat(int node, int time);
+	en_stat ENtotal();
+	long ENcrossZone();
+	virtual void *ENinit(Address *myaddr, short port);
+	char *ENalloc(int size, void (*dtor)(char *) = NULL);
+	int ENsend(Address *myaddr, Address *toaddr, const string &data);
 	int ENsend(Address *myaddr, Address *toaddr, char *data, int size);
-	int ENrecv(Address *myaddr, int (* enq)(void *, char *, int), struct timeval *t, int times, void *queue);
-	int ENcleanup();
+	virtual int ENsendBuffer(Address *myaddr, Address *toaddr, char *buffer);
+	int ENmulticast(Address *myaddr, vector<Address> &toaddrs, char *buffer);
+	virtual int ENrecv(Address *myaddr, int (* enq)(void *, char *, int), struct timeval *t, int times, void *queue);
+	virtual int ENpurge(Address *myaddr);
+	void ENretain(char *buffer);
+	void ENrelease(char *buffer);
+	virtual int ENcredits(Address *myaddr);
+	virtual int ENflush();
+	virtual int ENcleanup();
 };
 
 #endif /* _EMULNET_H_ */
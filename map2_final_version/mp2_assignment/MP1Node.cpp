@@ -25,6 +25,17 @@ MP1Node::MP1Node(Member *member, Params *params, EmulNet *emul, Log *log, Addres
 	this->log = log;
 	this->par = params;
 	this->memberNode->addr = *address;
+	this->probeSeq = 0;
+	this->probeTarget = 0;
+	this->probePort = 0;
+	this->probeStart = 0;
+	this->probeAcked = false;
+	this->probeIndirect = false;
+	this->probeNext = 0;
+	this->membershipVersion = 0;
+	this->memberDigest = 0;
+	this->piggybackTick = -1;
+	this->health = 0;
 }
 
 /**
@@ -36,10 +47,12 @@ MP1Node::~MP1Node() {}
  * FUNCTION NAME: recvLoop
  *
  * DESCRIPTION: This function receives message from the network and pushes into the queue
- * 				This function is called by a node to receive messages currently waiting for it
+ * 				This function is called by a node to receive messages currently waiting for it.
+ * 				A failed node drops them instead so that the senders get their credits back.
  */
 int MP1Node::recvLoop() {
     if ( memberNode->bFailed ) {
+    	emulNet->ENpurge(&(memberNode->addr));
     	return false;
     }
     else {
@@ -104,8 +117,10 @@ int MP1Node::initThisNode(Address *joinaddr) {
 	memberNode->inGroup = false;
     // node is up!
 	memberNode->nnb = 0;
-	memberNode->heartbeat = 0;
-	memberNode->pingCounter = TFAIL;
+	// The heartbeat starts at the tick the node starts, its incarnation, so whatever
+	// a restarted node sends is newer than anything its previous life sent
+	memberNode->heartbeat = par->getcurrtime();
+	memberNode->pingCounter = par->T_FAIL;
 	memberNode->timeOutCounter = -1;
     initMemberListTable(memberNode);
 
@@ -133,7 +148,6 @@ int MP1Node::initThisNode(Address *joinaddr) {
    ʹemulNet->ENsendõļϢ͸ַjoinaddr
  */
 int MP1Node::introduceSelfToGroup(Address *joinaddr) {
-	MessageHdr *msg;
 #ifdef DEBUGLOG
     static char s[1024];
 #endif
@@ -156,24 +170,17 @@ int MP1Node::introduceSelfToGroup(Address *joinaddr) {
         
         //******a new way********
         // create JOINREQ message: format of data is {struct Address myaddr}
-        msg = new MessageHdr();
-        msg->msgType = JOINREQ;
-        msg->member_vector = memberNode->memberList;
-
         //add member_vector into the req is to quickly synchronize, with the same data,check and optmize the network
         //address information
-        msg->addr = &memberNode->addr;
-
 #ifdef DEBUGLOG
         sprintf(s, "Trying to join...");
         log->LOG(&memberNode->addr, s);
 #endif
 
         // send JOINREQ message to introducer member
-        emulNet->ENsend(&memberNode->addr, joinaddr, (char *)msg, sizeof(MessageHdr));
-
-        //free(msg);
-        delete msg;
+        send_message(joinaddr, JOINREQ);
+        // Ask another introducer if no JOINREP comes within T_FAIL ticks
+        memberNode->timeOutCounter = par->T_FAIL;
     }
 
     return 1;
@@ -183,12 +190,79 @@ int MP1Node::introduceSelfToGroup(Address *joinaddr) {
 /**
  * FUNCTION NAME: finishUpThisNode
  *
- * DESCRIPTION: Wind up this node and clean up state
+ * DESCRIPTION: Wind up this node and clean up state.
+ * 				A member of the group leaving on purpose tells the group with a LEAVE first,
+ * 				so it is dropped at once instead of after a failure detection timeout.
+ * 				announce is false when the whole run shuts down and nobody is left to hear it.
+ */
+int MP1Node::finishUpThisNode(bool announce){
+    if (announce && memberNode->inGroup && !memberNode->bFailed) {
+        int id = *(int*)(&memberNode->addr.addr);
+        short port = *(short*)(&memberNode->addr.addr[4]);
+        MemberListEntry self(id, port, memberNode->heartbeat, par->getcurrtime());
+        send_leave(self, memberNode->memberList.size());
+    }
+    memberNode->inGroup = false;
+    initMemberListTable(memberNode);
+    return 0;
+}
+
+/**
+ * FUNCTION NAME: send_leave
+ *
+ * DESCRIPTION: Send a LEAVE about leaver to k random members
  */
-int MP1Node::finishUpThisNode(){
-   /*
-    * Your code goes here
-    */
+void MP1Node::send_leave(MemberListEntry& leaver, int k) {
+    if (k == 0) {
+        return;
+    }
+    vector<int> order = sample_members(k);
+    vector<Address> targets(k);
+    for (int i = 0; i < k; i++) {
+        memcpy(&targets[i].addr[0], &memberNode->memberList[order[i]].id, sizeof(int));
+        memcpy(&targets[i].addr[4], &memberNode->memberList[order[i]].port, sizeof(short));
+    }
+    char* buffer = build_leave(leaver);
+    emulNet->ENmulticast(&memberNode->addr, targets, buffer);
+    emulNet->ENrelease(buffer);
+}
+
+/**
+ * FUNCTION NAME: leave_handler
+ *
+ * DESCRIPTION: Drop a member that left and tombstone it, so stale gossip does not bring it back.
+ * 				The leaver tells every member itself. The first time a member hears of the leave it
+ * 				passes the LEAVE on to log2(n) others, or GOSSIP_FANOUT if that is more, which covers
+ * 				the direct LEAVEs lost on the way; later copies find the member gone and stop there.
+ */
+void MP1Node::leave_handler(MessageHdr* msg) {
+    int id = *(int*)(&memberNode->addr.addr);
+    short port = *(short*)(&memberNode->addr.addr[4]);
+    for (int i = 0; i < msg->count; i++) {
+        MemberListEntry leaver = member_entries(msg)[i];
+        if (leaver.id == id && leaver.port == port) {
+            continue;
+        }
+        MemberListEntry* e = check_member_list(leaver.id, leaver.port);
+        if (e == nullptr) {
+            add_tombstone(leaver.id, leaver.port, leaver.heartbeat);
+            continue;
+        }
+        leaver.heartbeat = max(leaver.heartbeat, e->heartbeat);
+        if (par->DETECTOR == SWIM_DETECTOR) {
+            swim_confirm(leaver.id, leaver.port, leaver.heartbeat);
+        }
+        else {
+            Address* removed_addr = get_address(leaver.id, leaver.port);
+            log->logNodeRemove(&memberNode->addr, removed_addr);
+            add_tombstone(leaver.id, leaver.port, leaver.heartbeat);
+            remove_member(e - &memberNode->memberList[0]);
+            delete removed_addr;
+        }
+        int n = memberNode->memberList.size();
+        int k = par->GOSSIP_FANOUT > 0 ? max(par->GOSSIP_FANOUT, (int)ceil(log2(n + 1))) : n;
+        send_leave(leaver, min(k, n));
+    }
 }
 
 /**
@@ -207,6 +281,10 @@ void MP1Node::nodeLoop() {
 
     // Wait until you're in the group...
     if( !memberNode->inGroup ) {
+        if (memberNode->timeOutCounter > 0 && --memberNode->timeOutCounter == 0) {
+            Address joinaddr = getJoinAddress();
+            introduceSelfToGroup(&joinaddr);
+        }
     	return;
     }
 
@@ -224,14 +302,23 @@ void MP1Node::nodeLoop() {
 void MP1Node::checkMessages() {
     void *ptr;
     int size;
+    // An overloaded node gets through only part of its queue each tick
+    int budget = par->getBudget(*(int*)(&memberNode->addr.addr));
+    int handled = 0;
+    if (budget > 0 && par->DETECTOR == SWIM_DETECTOR && (int)memberNode->mp1q.size() > budget) {
+        swim_prioritize();
+    }
 
     // Pop waiting messages from memberNode's mp1q
-    while ( !memberNode->mp1q.empty() ) {
+    while ( !memberNode->mp1q.empty() && (budget == 0 || handled < budget) ) {
     	ptr = memberNode->mp1q.front().elt;
     	size = memberNode->mp1q.front().size;
     	memberNode->mp1q.pop();
     	recvCallBack((void *)memberNode, (char *)ptr, size);
+    	handled++;
     }
+    // Messages left over mean this node is behind, a drained queue that it is keeping up
+    health_event(memberNode->mp1q.empty() ? -1 : 1);
     return;
 }
 
@@ -245,14 +332,36 @@ bool MP1Node::recvCallBack(void *env, char *data, int size ) {
 	/*
 	 * Your code goes here
 	 */
-    MessageHdr* msg = (MessageHdr*)data;
+    MessageHdr hdr;
+    MessageHdr* msg = &hdr;
+    if (size > 0 && (data[0] == PROBE || data[0] == ACK || data[0] == PINGREQ)) {
+        SwimHdr swim;
+        if (decode_swim(data, size, &swim)) {
+            swim_handler(&swim);
+        }
+        emulNet->ENrelease(data);
+        return true;
+    }
+    if (!decode_message(data, size, msg)) {
+        emulNet->ENrelease(data);
+        return false;
+    }
     if (msg->msgType == JOINREQ) {
         //1.add to memberlist
         push_member_list(msg);
-        //2.send JOINREP to source node
-        Address* toaddr = msg->addr;
+        if (par->DETECTOR == SWIM_DETECTOR) {
+            MemberListEntry* joined = check_member_list(&msg->addr);
+            swim_enqueue(joined->id, joined->port, ALIVE, joined->heartbeat);
+        }
+        //2.send JOINREP to source node, with the other joiners of this round
+        Address* toaddr = &msg->addr;
         // cout << "JOINREQ : from " << toaddr->getAddress() << " to " << memberNode->addr.getAddress() << endl; 
-        send_message(toaddr, JOINREP);   
+        if (find(pendingJoins.begin(), pendingJoins.end(), *toaddr) == pendingJoins.end()) {
+            pendingJoins.push_back(*toaddr);
+        }
+    }
+    else if (msg->msgType == JOINREP && par->DETECTOR == SWIM_DETECTOR) {
+        swim_join_reply(msg);
     }
     else if (msg->msgType == JOINREP) {
         // 1. add to memberlist
@@ -266,7 +375,22 @@ bool MP1Node::recvCallBack(void *env, char *data, int size ) {
         // cout << "PING : from " << msg->addr->getAddress() << " to " << memberNode->addr.getAddress() << endl;
         ping_handler(msg);
     }
-    delete msg;
+    else if (msg->msgType == SYNC) {
+        // Push-pull: take the whole list, answer with ours
+        ping_handler(msg);
+        send_message(&msg->addr, PING);
+    }
+    else if (msg->msgType == LEAVE) {
+        leave_handler(msg);
+    }
+    else if (msg->msgType == DIGEST) {
+        // Views that match need nothing more, otherwise start the whole list push-pull
+        update_src_member(msg);
+        if (msg->members != (int)memberNode->memberList.size() + 1 || msg->digest != memberDigest) {
+            send_message(&msg->addr, SYNC);
+        }
+    }
+    emulNet->ENrelease(data);
     return true;
 }
 
@@ -282,14 +406,15 @@ void MP1Node::push_member_list(MessageHdr* msg) {
     // id, port, heartbeat, timestamp
     int id = 0;
     short port;
-    memcpy(&id, &msg->addr->addr[0], sizeof(int));
-    memcpy(&port, &msg->addr->addr[4], sizeof(short));
-    long heartbeat = 1;
+    memcpy(&id, &msg->addr.addr[0], sizeof(int));
+    memcpy(&port, &msg->addr.addr[4], sizeof(short));
+    long heartbeat = msg->heartbeat;
     long timestamp = this->par->getcurrtime();
     if (check_member_list(id, port) != nullptr)
         return;
+    // The node itself is talking to us, so a tombstone does not apply
     MemberListEntry e(id, port, heartbeat, timestamp);
-    memberNode->memberList.push_back(e);
+    add_member(e);
     Address* added = get_address(id, port);
     log->logNodeAdd(&memberNode->addr, added);
     delete added;
@@ -312,14 +437,140 @@ void MP1Node::push_member_list(MemberListEntry* e) {
         return;
     }
 
-    if (par->getcurrtime() - e->timestamp < TREMOVE) {
+    // Stale gossip about a member removed here does not bring it back
+    if (check_tombstone(e->id, e->port, e->heartbeat)) {
+        delete addr;
+        return;
+    }
+
+    if (par->getcurrtime() - e->timestamp < par->T_REMOVE) {
         log->logNodeAdd(&memberNode->addr, addr);
         MemberListEntry new_entry = *e;
-        memberNode->memberList.push_back(new_entry);
+        add_member(new_entry);
     }
     delete addr;
 }
 
+/**
+ * FUNCTION NAME: answer_joins
+ *
+ * DESCRIPTION: Answer every JOINREQ of the round with one JOINREP, encoded once and sent to each joiner.
+ * 				Under SWIM the joiner takes the whole member list from it, so a list too large for one
+ * 				message is split over as many JOINREPs as it takes.
+ */
+void MP1Node::answer_joins() {
+    if (pendingJoins.empty()) {
+        return;
+    }
+    if (par->DETECTOR != SWIM_DETECTOR) {
+        char* buffer = build_message(JOINREP);
+        emulNet->ENmulticast(&memberNode->addr, pendingJoins, buffer);
+        emulNet->ENrelease(buffer);
+        pendingJoins.clear();
+        return;
+    }
+    int n = memberNode->memberList.size();
+    vector<int> order(n);
+    for (int i = 0; i < n; i++) {
+        order[i] = i;
+    }
+    int first = 0;
+    do {
+        int count = fit_entries(order, first);
+        char* buffer = encode_message(JOINREP, order, first, count);
+        emulNet->ENmulticast(&memberNode->addr, pendingJoins, buffer);
+        emulNet->ENrelease(buffer);
+        if (count == 0) {
+            break;
+        }
+        first += count;
+    } while (first < n);
+    pendingJoins.clear();
+}
+
+/**
+ * FUNCTION NAME: health_event
+ *
+ * DESCRIPTION: Move the local health score by delta, within 0 and LOCAL_HEALTH
+ */
+void MP1Node::health_event(int delta) {
+    if (par->LOCAL_HEALTH <= 0) {
+        return;
+    }
+    health = min(par->LOCAL_HEALTH, max(0, health + delta));
+}
+
+/**
+ * FUNCTION NAME: health_scale
+ *
+ * DESCRIPTION: Factor the timeouts and the gossip or probe interval of this node are stretched by,
+ * 				1 while it keeps up, Lifeguard style
+ */
+int MP1Node::health_scale() {
+    return 1 + health;
+}
+
+/**
+ * FUNCTION NAME: piggyback
+ *
+ * DESCRIPTION: Membership to carry on a KV message: this node's heartbeat and up to PIGGYBACK_ENTRIES
+ * 				entries changed this tick, in the build_message format. Encoded once per tick.
+ * 				Nothing is carried before the node is in the group or under SWIM.
+ * 				Call with cap = 0 to get the length.
+ *
+ * RETURNS:
+ * the length of the encoding
+ */
+int MP1Node::piggyback(char* out, int cap) {
+    if (!memberNode->inGroup || memberNode->bFailed || par->DETECTOR == SWIM_DETECTOR) {
+        return 0;
+    }
+    int now = par->getcurrtime();
+    if (piggybackTick != now) {
+        char* buffer = build_message(PING, now - 1, PIGGYBACK_ENTRIES);
+        piggybackCache.assign(buffer, ((en_buf*)buffer - 1)->size);
+        emulNet->ENrelease(buffer);
+        piggybackTick = now;
+    }
+    if ((int)piggybackCache.size() <= cap) {
+        memcpy(out, piggybackCache.data(), piggybackCache.size());
+    }
+    return piggybackCache.size();
+}
+
+/**
+ * FUNCTION NAME: piggyback_handler
+ *
+ * DESCRIPTION: Membership carried on a KV message. The sender is plainly alive, so its entry is
+ * 				refreshed with the heartbeat it sent, and it is left out of gossip rounds for the next
+ * 				PIGGYBACK ticks. The changed entries are merged as from a PING.
+ */
+void MP1Node::piggyback_handler(const char* data, int size) {
+    MessageHdr msg;
+    if (size <= 0 || !memberNode->inGroup || memberNode->bFailed || !decode_message((char*)data, size, &msg)) {
+        return;
+    }
+    int id = 0;
+    short port = 0;
+    memcpy(&id, &msg.addr.addr[0], sizeof(int));
+    memcpy(&port, &msg.addr.addr[4], sizeof(short));
+    // A coordinator is often a replica of its own key
+    if (msg.addr == memberNode->addr) {
+        return;
+    }
+    MemberListEntry* src = check_member_list(id, port);
+    if (src == nullptr) {
+        push_member_list(&msg);
+    }
+    else {
+        src->heartbeat = max(src->heartbeat, msg.heartbeat);
+        src->timestamp = par->getcurrtime();
+        touch_member(src);
+    }
+    kvHeard[member_key(id, port)] = par->getcurrtime();
+    merge_entries(&msg);
+}
+
 /**
  * FUNCTION NAME: get_address
  *
@@ -338,49 +589,583 @@ Address* MP1Node::get_address(int id, short port) {
  * DESCRIPTION: If the node exists in the memberList, the function will return pointer. Otherwise, the function will return false.
  */
 MemberListEntry* MP1Node::check_member_list(int id, short port) {
-    for (int i = 0; i < memberNode->memberList.size(); i++) {
-        if (memberNode->memberList[i].id == id && memberNode->memberList[i].port == port)
-            return &memberNode->memberList[i];//һMemberNodeʵ
-        //һָǰMemberNodeʵĳԱб(memberList)еiԪصָ룬ԪһMemberListEntry
-        //MemberListEntryͨ˷ֲʽϵͳĳڵľϢڵID˿ںš
-        // ֵһθµʱȡ
-    }
-    return nullptr;
+    unordered_map<long, int>::iterator it = memberIndex.find(member_key(id, port));
+    if (it == memberIndex.end())
+        return nullptr;
+    return &memberNode->memberList[it->second];//һMemberNodeʵ
+    //һָǰMemberNodeʵĳԱб(memberList)еiԪصָ룬ԪһMemberListEntry
+    //MemberListEntryͨ˷ֲʽϵͳĳڵľϢڵID˿ںš
+    // ֵһθµʱȡ
 }
 
 MemberListEntry* MP1Node::check_member_list(Address* node_addr) {
-    for (int i = 0; i < memberNode->memberList.size(); i++) {
-        int id = 0;
-        short port = 0;
-        memcpy(&id, &node_addr->addr[0], sizeof(int));
-        memcpy(&port, &node_addr->addr[4], sizeof(short));
-        if (memberNode->memberList[i].id == id && memberNode->memberList[i].port == port)
-            return &memberNode->memberList[i];
-    }
-    return nullptr;
+    int id = 0;
+    short port = 0;
+    memcpy(&id, &node_addr->addr[0], sizeof(int));
+    memcpy(&port, &node_addr->addr[4], sizeof(short));
+    return check_member_list(id, port);
 }
 
-
 //ڴУMemberNodeһṹʵ˽ڵ״̬Ϣַȡ
 //MemberListEntry Ƿֲʽϵͳнڵڼ¼ڵϢݽṹÿMemberListEntryĿͨ
 // һڵıʶIDַһθµʱϢ
 
 
+/**
+ * FUNCTION NAME: member_key
+ *
+ * DESCRIPTION: Key of a member in memberIndex
+ */
+long MP1Node::member_key(int id, short port) {
+    return ((long)id << 16) | (unsigned short)port;
+}
+
+/**
+ * FUNCTION NAME: add_member
+ *
+ * DESCRIPTION: Append an entry to the memberList and index it. Pointers into the list
+ * 				may move, so callers look entries up again afterwards.
+ */
+void MP1Node::add_member(MemberListEntry& e) {
+    memberIndex[member_key(e.id, e.port)] = memberNode->memberList.size();
+    memberNode->memberList.push_back(e);
+    memberVersion.push_back(par->getcurrtime());
+    memberSeen.push_back(e.timestamp);
+    memberDigest += digest_key(member_key(e.id, e.port));
+    tombstones.erase(member_key(e.id, e.port));
+    publish_change();
+    if (par->DETECTOR == PHI_DETECTOR) {
+        PhiWindow w;
+        memset(&w, 0, sizeof(w));
+        w.last = par->getcurrtime();
+        arrivals[member_key(e.id, e.port)] = w;
+    }
+}
+
+/**
+ * FUNCTION NAME: remove_member
+ *
+ * DESCRIPTION: Remove the entry at position i by moving the last entry into its place,
+ * 				so nothing behind it shifts. Removing while walking the list backwards is safe.
+ */
+void MP1Node::remove_member(int i) {
+    vector<MemberListEntry>& list = memberNode->memberList;
+    long key = member_key(list[i].id, list[i].port);
+    memberIndex.erase(key);
+    memberDigest -= digest_key(key);
+    peerSynced.erase(key);
+    arrivals.erase(key);
+    int last = list.size() - 1;
+    if (i != last) {
+        list[i] = list[last];
+        memberVersion[i] = memberVersion[last];
+        memberSeen[i] = memberSeen[last];
+        memberIndex[member_key(list[i].id, list[i].port)] = i;
+    }
+    list.pop_back();
+    memberVersion.pop_back();
+    memberSeen.pop_back();
+    publish_change();
+}
+
+/**
+ * FUNCTION NAME: expire_member
+ *
+ * DESCRIPTION: Remove the member at position i as failed and tombstone it
+ */
+void MP1Node::expire_member(int i) {
+    MemberListEntry& e = memberNode->memberList[i];
+    Address* removed_addr = get_address(e.id, e.port);
+    log->logNodeRemove(&memberNode->addr, removed_addr);
+    add_tombstone(e.id, e.port, e.heartbeat);
+    remove_member(i);
+    delete removed_addr;
+}
+
+/**
+ * FUNCTION NAME: sweep_expired
+ *
+ * DESCRIPTION: Write to out, in increasing order, the positions in seen[0..n) at or before deadline.
+ * 				With SSE2 four timestamps are compared per instruction, and the movemask of the
+ * 				comparison says which of them to write out; most groups of four have none.
+ *
+ * RETURNS:
+ * number of positions written
+ */
+int MP1Node::sweep_expired(const int* seen, int n, int deadline, int* out) {
+    int count = 0;
+    int i = 0;
+#ifdef __SSE2__
+    // seen <= deadline is deadline + 1 > seen
+    __m128i limit = _mm_set1_epi32(deadline + 1);
+    for (; i + 4 <= n; i += 4) {
+        __m128i stamps = _mm_loadu_si128((const __m128i*)(seen + i));
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(limit, stamps)));
+        while (mask) {
+            int bit = __builtin_ctz(mask);
+            out[count++] = i + bit;
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        if (seen[i] <= deadline) {
+            out[count++] = i;
+        }
+    }
+    return count;
+}
+
+/**
+ * FUNCTION NAME: subscribe
+ *
+ * DESCRIPTION: Have listener called with env and the new membership version whenever
+ * 				the member set changes
+ */
+void MP1Node::subscribe(MembershipListener listener, void *env) {
+    listeners.push_back(make_pair(listener, env));
+}
+
+/**
+ * FUNCTION NAME: publish_change
+ *
+ * DESCRIPTION: Advance the membership version and tell the listeners
+ */
+void MP1Node::publish_change() {
+    membershipVersion++;
+    for (int i = 0; i < (int)listeners.size(); i++) {
+        listeners[i].first(listeners[i].second, membershipVersion);
+    }
+}
+
+/**
+ * FUNCTION NAME: add_tombstone
+ *
+ * DESCRIPTION: Remember that a member was removed at heartbeat (incarnation under SWIM).
+ * 				The tombstone lasts TOMBSTONE ticks, long enough for the stale copies
+ * 				other members still hold to time out.
+ */
+void MP1Node::add_tombstone(int id, short port, long heartbeat) {
+    Tombstone& t = tombstones[member_key(id, port)];
+    t.heartbeat = max(t.heartbeat, heartbeat);
+    t.expires = par->getcurrtime() + (par->TOMBSTONE > 0 ? par->TOMBSTONE : 2 * par->T_REMOVE);
+}
+
+/**
+ * FUNCTION NAME: check_tombstone
+ *
+ * RETURNS:
+ * true if the member was removed here at heartbeat or later, so news at heartbeat is stale
+ */
+bool MP1Node::check_tombstone(int id, short port, long heartbeat) {
+    unordered_map<long, Tombstone>::iterator it = tombstones.find(member_key(id, port));
+    return it != tombstones.end() && it->second.expires > par->getcurrtime() && heartbeat <= it->second.heartbeat;
+}
+
+/**
+ * FUNCTION NAME: sweep_tombstones
+ *
+ * DESCRIPTION: Forget expired tombstones
+ */
+void MP1Node::sweep_tombstones() {
+    for (unordered_map<long, Tombstone>::iterator it = tombstones.begin(); it != tombstones.end();) {
+        if (it->second.expires <= par->getcurrtime()) {
+            it = tombstones.erase(it);
+        }
+        else {
+            it++;
+        }
+    }
+}
+
+
 /**
  * FUNCTION NAME: send_message
  *
  * DESCRIPTION: send message
  */
 void MP1Node::send_message(Address* toaddr, MsgTypes t) {
-    //auto msg = std::make_unique<MessageHdr>(); // ʹָԶڴ
-    MessageHdr* msg = new MessageHdr();
-    //MessageHdr* msg = new MessageHdr();
-    msg->msgType = t;
-    msg->member_vector = memberNode->memberList;
-    msg->addr = &memberNode->addr;
-    emulNet->ENsend(&memberNode->addr, toaddr, (char*)msg, sizeof(MessageHdr));
+    char* buffer = build_message(t);
+    emulNet->ENsendBuffer(&memberNode->addr, toaddr, buffer);
     //ͨEmulNet㷢ϢEmulNetģ绷һ
     //ڽڵ䴫ϢдǽmsgΪϢӵǰڵ㷢͵Ŀĵַtoaddr
+    emulNet->ENrelease(buffer);
+}
+
+/**
+ * FUNCTION NAME: build_message
+ *
+ * DESCRIPTION: Encode a message of type t into a new EmulNet buffer, owned by the caller.
+ * 				With since >= 0 only the entries that changed after tick since are carried.
+ * 				Wire format, every integer a varint:
+ * 				type byte, sender id, sender port, zigzag(sender heartbeat), sender tick, count,
+ * 				then per entry: id, port, zigzag(heartbeat - sender heartbeat), sender tick - timestamp.
+ * 				Heartbeats of one group stay close together and timestamps are recent, so both
+ * 				differences are short.
+ */
+char* MP1Node::build_message(MsgTypes t, int since, int limit) {
+    // Copy the member list behind the header so the message is self contained,
+    // or a random GOSSIP_ENTRIES (or limit) of it when that is set
+    int n = memberNode->memberList.size();
+    int entries = limit > 0 ? limit : par->GOSSIP_ENTRIES;
+    vector<int> order;
+    for (int i = 0; i < n; i++) {
+        if (since < 0 || memberVersion[i] > since) {
+            order.push_back(i);
+        }
+    }
+    int count = order.size();
+    if (entries > 0 && entries < count) {
+        if (since < 0) {
+            order = sample_members(entries);
+        }
+        else {
+            for (int i = 0; i < entries; i++) {
+                swap(order[i], order[i + rand() % (count - i)]);
+            }
+            order.resize(entries);
+        }
+        count = entries;
+    }
+    // The whole list of a large group does not fit in one message, and EmulNet would drop it.
+    // Carry a random sample of it that fits instead.
+    int fit = fit_entries(order, 0);
+    if (fit < count) {
+        for (int i = 0; i < count - 1; i++) {
+            swap(order[i], order[i + rand() % (count - i)]);
+        }
+        fit = fit_entries(order, 0);
+    }
+    return encode_message(t, order, 0, fit);
+}
+
+/**
+ * FUNCTION NAME: fit_entries
+ *
+ * DESCRIPTION: How many of the members order[first], order[first + 1], ... fit in one message,
+ * 				which EmulNet drops once its size with the en_msg header reaches MAX_MSG_SIZE
+ */
+int MP1Node::fit_entries(vector<int>& order, int first) {
+    vector<MemberListEntry>& list = memberNode->memberList;
+    int now = par->getcurrtime();
+    long base = memberNode->heartbeat;
+    int left = (int)order.size() - first;
+    int room = par->MAX_MSG_SIZE - (int)sizeof(en_msg) - 1
+             - (1 + varint_size(*(int*)&memberNode->addr.addr[0]) + varint_size(*(unsigned short*)&memberNode->addr.addr[4])
+                + varint_size(zigzag(base)) + varint_size(now) + varint_size(max(left, 0)));
+    int fit = 0;
+    while (fit < left) {
+        MemberListEntry& e = list[order[first + fit]];
+        room -= varint_size(e.id) + varint_size((unsigned short)e.port) + varint_size(zigzag(e.heartbeat - base))
+              + varint_size(max(0L, now - e.timestamp));
+        if (room < 0) {
+            break;
+        }
+        fit++;
+    }
+    return fit;
+}
+
+/**
+ * FUNCTION NAME: encode_message
+ *
+ * DESCRIPTION: Encode a message of type t carrying the members order[first] to order[first + count - 1]
+ * 				into a new EmulNet buffer, owned by the caller. See build_message for the wire format.
+ */
+char* MP1Node::encode_message(MsgTypes t, vector<int>& order, int first, int count) {
+    // Size the encoding first so the buffer is allocated once at its exact length
+    vector<MemberListEntry>& list = memberNode->memberList;
+    int now = par->getcurrtime();
+    long base = memberNode->heartbeat;
+    int id = 0;
+    short port = 0;
+    memcpy(&id, &memberNode->addr.addr[0], sizeof(int));
+    memcpy(&port, &memberNode->addr.addr[4], sizeof(short));
+    int size = 1 + varint_size(id) + varint_size((unsigned short)port) + varint_size(zigzag(base)) + varint_size(now)
+             + varint_size(count);
+    for (int i = first; i < first + count; i++) {
+        MemberListEntry& e = list[order[i]];
+        size += varint_size(e.id) + varint_size((unsigned short)e.port) + varint_size(zigzag(e.heartbeat - base))
+              + varint_size(max(0L, now - e.timestamp));
+    }
+
+    char* buffer = emulNet->ENalloc(size);
+    char* out = buffer;
+    *out++ = (char)t;
+    out = put_varint(out, id);
+    out = put_varint(out, (unsigned short)port);
+    out = put_varint(out, zigzag(base));
+    out = put_varint(out, now);
+    out = put_varint(out, count);
+    for (int i = first; i < first + count; i++) {
+        MemberListEntry& e = list[order[i]];
+        out = put_varint(out, e.id);
+        out = put_varint(out, (unsigned short)e.port);
+        out = put_varint(out, zigzag(e.heartbeat - base));
+        out = put_varint(out, max(0L, now - e.timestamp));
+    }
+    return buffer;
+}
+
+/**
+ * FUNCTION NAME: build_leave
+ *
+ * DESCRIPTION: Encode a LEAVE in the build_message format, with leaver as its only entry
+ */
+char* MP1Node::build_leave(MemberListEntry& leaver) {
+    int now = par->getcurrtime();
+    long base = memberNode->heartbeat;
+    int id = 0;
+    short port = 0;
+    memcpy(&id, &memberNode->addr.addr[0], sizeof(int));
+    memcpy(&port, &memberNode->addr.addr[4], sizeof(short));
+    int size = 1 + varint_size(id) + varint_size((unsigned short)port) + varint_size(zigzag(base)) + varint_size(now)
+             + varint_size(1) + varint_size(leaver.id) + varint_size((unsigned short)leaver.port)
+             + varint_size(zigzag(leaver.heartbeat - base)) + varint_size(0);
+
+    char* buffer = emulNet->ENalloc(size);
+    char* out = buffer;
+    *out++ = (char)LEAVE;
+    out = put_varint(out, id);
+    out = put_varint(out, (unsigned short)port);
+    out = put_varint(out, zigzag(base));
+    out = put_varint(out, now);
+    out = put_varint(out, 1);
+    out = put_varint(out, leaver.id);
+    out = put_varint(out, (unsigned short)leaver.port);
+    out = put_varint(out, zigzag(leaver.heartbeat - base));
+    out = put_varint(out, 0);
+    return buffer;
+}
+
+/**
+ * FUNCTION NAME: build_digest
+ *
+ * DESCRIPTION: Encode a DIGEST: the build_message header with no entries, then the number of
+ * 				members in this node's view, itself included, as a varint and memberDigest as 8 bytes
+ */
+char* MP1Node::build_digest() {
+    int now = par->getcurrtime();
+    long base = memberNode->heartbeat;
+    int id = 0;
+    short port = 0;
+    int members = memberNode->memberList.size() + 1;
+    memcpy(&id, &memberNode->addr.addr[0], sizeof(int));
+    memcpy(&port, &memberNode->addr.addr[4], sizeof(short));
+    int size = 1 + varint_size(id) + varint_size((unsigned short)port) + varint_size(zigzag(base)) + varint_size(now)
+             + varint_size(0) + varint_size(members) + sizeof(unsigned long);
+
+    char* buffer = emulNet->ENalloc(size);
+    char* out = buffer;
+    *out++ = (char)DIGEST;
+    out = put_varint(out, id);
+    out = put_varint(out, (unsigned short)port);
+    out = put_varint(out, zigzag(base));
+    out = put_varint(out, now);
+    out = put_varint(out, 0);
+    out = put_varint(out, members);
+    memcpy(out, &memberDigest, sizeof(unsigned long));
+    return buffer;
+}
+
+/**
+ * FUNCTION NAME: digest_key
+ *
+ * DESCRIPTION: Scramble a member_key so that a plain sum over a view is a usable digest of it.
+ * 				A sum does not depend on the order of the members and takes one add or subtract
+ * 				per change. The mix is the splitmix64 finalizer.
+ */
+unsigned long MP1Node::digest_key(long key) {
+    unsigned long z = (unsigned long)key + 0x9e3779b97f4a7c15UL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9UL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebUL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * FUNCTION NAME: sample_members
+ *
+ * DESCRIPTION: Indices of k distinct random members. Asking for the whole list returns it in order.
+ */
+vector<int> MP1Node::sample_members(int k) {
+    int n = memberNode->memberList.size();
+    vector<int> order(n);
+    for (int i = 0; i < n; i++) {
+        order[i] = i;
+    }
+    if (k < n) {
+        // Partial Fisher-Yates shuffle, only the first k positions are drawn
+        for (int i = 0; i < k; i++) {
+            swap(order[i], order[i + rand() % (n - i)]);
+        }
+        order.resize(k);
+    }
+    return order;
+}
+
+/**
+ * FUNCTION NAME: gossip_targets
+ *
+ * DESCRIPTION: Indices of k distinct random members to gossip to. With zones they are drawn from
+ * 				this node's zone, except one from another zone when cross is set. A zone too small
+ * 				for k is topped up from the others.
+ */
+vector<int> MP1Node::gossip_targets(int k, bool cross) {
+    int n = memberNode->memberList.size();
+    if (par->ZONES <= 1 || k >= n) {
+        return sample_members(k);
+    }
+    int zone = par->getZone(*(int*)(&memberNode->addr.addr));
+    vector<int> local, remote;
+    for (int i = 0; i < n; i++) {
+        if (par->getZone(memberNode->memberList[i].id) == zone) {
+            local.push_back(i);
+        }
+        else {
+            remote.push_back(i);
+        }
+    }
+    int r = min(cross ? 1 : 0, (int)remote.size());
+    int l = min(k - r, (int)local.size());
+    r = k - l;
+
+    vector<int> order;
+    for (int i = 0; i < l; i++) {
+        swap(local[i], local[i + rand() % (local.size() - i)]);
+        order.push_back(local[i]);
+    }
+    for (int i = 0; i < r; i++) {
+        swap(remote[i], remote[i + rand() % (remote.size() - i)]);
+        order.push_back(remote[i]);
+    }
+    return order;
+}
+
+/**
+ * FUNCTION NAME: member_entries
+ *
+ * DESCRIPTION: The member list decoded from msg, valid until the next message is decoded
+ */
+MemberListEntry* MP1Node::member_entries(MessageHdr* msg) {
+    return decodedEntries.empty() ? nullptr : &decodedEntries[0];
+}
+
+/**
+ * FUNCTION NAME: decode_message
+ *
+ * DESCRIPTION: Decode a message written by build_message into msg and decodedEntries.
+ * 				decodedEntries keeps its capacity, so decoding allocates nothing once it has grown.
+ *
+ * RETURNS:
+ * false if the message is truncated
+ */
+bool MP1Node::decode_message(char* data, int size, MessageHdr* msg) {
+    const char* in = data + 1;
+    const char* end = data + size;
+    unsigned long id, port, base, sent, count;
+    if (size < 1 || !(in = get_varint(in, end, &id)) || !(in = get_varint(in, end, &port)) ||
+        !(in = get_varint(in, end, &base)) || !(in = get_varint(in, end, &sent)) || !(in = get_varint(in, end, &count))) {
+        return false;
+    }
+    msg->msgType = (MsgTypes)data[0];
+    memset(msg->addr.addr, 0, sizeof(msg->addr.addr));
+    int sender = id;
+    short sender_port = port;
+    memcpy(&msg->addr.addr[0], &sender, sizeof(int));
+    memcpy(&msg->addr.addr[4], &sender_port, sizeof(short));
+    // An entry takes at least four bytes, so a larger count cannot be genuine
+    if (count > (unsigned long)(end - in) / 4) {
+        return false;
+    }
+    msg->heartbeat = unzigzag(base);
+    msg->count = count;
+
+    decodedEntries.resize(count);
+    for (unsigned long i = 0; i < count; i++) {
+        unsigned long heartbeat, age;
+        if (!(in = get_varint(in, end, &id)) || !(in = get_varint(in, end, &port)) ||
+            !(in = get_varint(in, end, &heartbeat)) || !(in = get_varint(in, end, &age))) {
+            return false;
+        }
+        MemberListEntry& e = decodedEntries[i];
+        e.id = id;
+        e.port = port;
+        e.heartbeat = unzigzag(base) + unzigzag(heartbeat);
+        e.timestamp = (long)sent - (long)age;
+    }
+    if (msg->msgType == DIGEST) {
+        unsigned long members;
+        if (!(in = get_varint(in, end, &members)) || end - in < (long)sizeof(unsigned long)) {
+            return false;
+        }
+        msg->members = members;
+        memcpy(&msg->digest, in, sizeof(unsigned long));
+    }
+    return true;
+}
+
+/**
+ * FUNCTION NAME: varint_size
+ *
+ * DESCRIPTION: Bytes of v as a varint, 7 bits per byte
+ */
+int MP1Node::varint_size(unsigned long v) {
+    int n = 1;
+    while (v >= 0x80) {
+        v >>= 7;
+        n++;
+    }
+    return n;
+}
+
+/**
+ * FUNCTION NAME: put_varint
+ *
+ * DESCRIPTION: Write v as a varint at p, low 7 bits first, the top bit set on every byte but the last
+ *
+ * RETURNS:
+ * the byte after it
+ */
+char* MP1Node::put_varint(char* p, unsigned long v) {
+    while (v >= 0x80) {
+        *p++ = (char)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (char)v;
+    return p;
+}
+
+/**
+ * FUNCTION NAME: get_varint
+ *
+ * DESCRIPTION: Read a varint at p into v
+ *
+ * RETURNS:
+ * the byte after it, or nullptr if it runs past end
+ */
+const char* MP1Node::get_varint(const char* p, const char* end, unsigned long* v) {
+    *v = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        unsigned char b = *p++;
+        *v |= (unsigned long)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            return p;
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * FUNCTION NAME: zigzag
+ *
+ * DESCRIPTION: Map signed to unsigned so small magnitudes of either sign make short varints
+ */
+unsigned long MP1Node::zigzag(long v) {
+    return ((unsigned long)v << 1) ^ (unsigned long)(v >> 63);
+}
+
+long MP1Node::unzigzag(unsigned long v) {
+    return (long)(v >> 1) ^ -(long)(v & 1);
 }
 //ıϵͳ״̬˵ǽڵA״̬ͨռӦJOINREPϢڵA֪ԼѾ磬
 // ܻȡڵϢڽڵAʼԼĳԱбʼеڵͨš
@@ -401,36 +1186,119 @@ void MP1Node::send_message(Address* toaddr, MsgTypes t) {
  */
 void MP1Node::ping_handler(MessageHdr* msg) {
     update_src_member(msg);
-    for (int i = 0; i < msg->member_vector.size(); i++) {
-        // cout << " id : " << msg->member_vector[i].id << " , port : " << msg->member_vector[i].port << endl;
-        if (msg->member_vector[i].id > 10 || msg->member_vector[i].id < 0) {
-            assert(1 != 1);
+    merge_entries(msg);
+}
+
+/**
+ * FUNCTION NAME: merge_entries
+ *
+ * DESCRIPTION: Take the newer heartbeats of the member list carried by msg, and add the members we do not know
+ *
+ * RETURNS:
+ * false if an entry has an id no node can have; the entries after it are ignored
+ */
+bool MP1Node::merge_entries(MessageHdr* msg) {
+    MemberListEntry* entries = member_entries(msg);
+    for (int i = 0; i < msg->count; i++) {
+        // cout << " id : " << entries[i].id << " , port : " << entries[i].port << endl;
+        if (entries[i].id < 0 || entries[i].id > MAX_NODES) {
+            return false;
         }
-        MemberListEntry* node = check_member_list(msg->member_vector[i].id, msg->member_vector[i].port);
+        MemberListEntry* node = check_member_list(entries[i].id, entries[i].port);
         //membernodeеÿһеĿ
         if (node != nullptr) {
-            if (msg->member_vector[i].heartbeat > node->heartbeat) {
-                node->heartbeat = msg->member_vector[i].heartbeat;
+            if (entries[i].heartbeat > node->heartbeat) {
+                node->heartbeat = entries[i].heartbeat;
                 node->timestamp = par->getcurrtime();
+                touch_member(node);
             }
         }//ȡģ
         else {
-            push_member_list(&msg->member_vector[i]);
+            push_member_list(&entries[i]);
         }//ûеǰڵ㣬ֳ뼴ɣ
     }
+    return true;
 }
 
 
 void MP1Node::update_src_member(MessageHdr* msg) {
-    MemberListEntry* src_member = check_member_list(msg->addr);
+    MemberListEntry* src_member = check_member_list(&msg->addr);
     if (src_member != nullptr) {
         src_member->heartbeat++;
         src_member->timestamp = par->getcurrtime();
+        touch_member(src_member);
     }
     else {
         push_member_list(msg);
     }
 }
+
+/**
+ * FUNCTION NAME: touch_member
+ *
+ * DESCRIPTION: Note that the heartbeat of e advanced. Delta gossip republishes a member
+ * 				at most every GOSSIP_DELTA ticks; a member whose heartbeat stops is not republished,
+ * 				so its peers time it out as before. The phi detector records the interval since the
+ * 				previous advance.
+ */
+void MP1Node::touch_member(MemberListEntry* e) {
+    int now = par->getcurrtime();
+    int i = e - &memberNode->memberList[0];
+    memberSeen[i] = e->timestamp;
+    if (now - memberVersion[i] >= par->GOSSIP_DELTA) {
+        memberVersion[i] = now;
+    }
+
+    if (par->DETECTOR != PHI_DETECTOR) {
+        return;
+    }
+    PhiWindow& w = arrivals[member_key(e->id, e->port)];
+    int interval = now - w.last;
+    if (interval <= 0) {
+        // Several advances within one tick are one arrival
+        return;
+    }
+    if (w.count == PHI_WINDOW) {
+        w.sum -= w.intervals[w.next];
+        w.sumSq -= (double)w.intervals[w.next] * w.intervals[w.next];
+    }
+    else {
+        w.count++;
+    }
+    w.intervals[w.next] = interval;
+    w.sum += interval;
+    w.sumSq += (double)interval * interval;
+    w.next = (w.next + 1) % PHI_WINDOW;
+    w.last = now;
+}
+
+/**
+ * FUNCTION NAME: phi
+ *
+ * DESCRIPTION: Suspicion level of a member: -log10 of the probability that its next heartbeat
+ * 				would come this late, with intervals taken as normally distributed around the mean
+ * 				of its recent ones. phi 1 means a 10% chance the member is still alive, 8 one in 10^8.
+ */
+double MP1Node::phi(int id, short port) {
+    unordered_map<long, PhiWindow>::iterator it = arrivals.find(member_key(id, port));
+    if (it == arrivals.end()) {
+        return 0;
+    }
+    PhiWindow& w = it->second;
+    // A node that is behind hears from everyone late, its clock is slowed by its local health
+    double elapsed = (par->getcurrtime() - w.last) / (double)health_scale();
+    if (w.count < PHI_MIN_SAMPLES) {
+        // Too few intervals to trust, a new member is judged by T_REMOVE
+        return elapsed >= par->T_REMOVE ? 1000 : 0;
+    }
+    double mean = w.sum / w.count;
+    double variance = w.sumSq / w.count - mean * mean;
+    // Gossiped heartbeats arrive in bursts, so the deviation is never taken below half the mean
+    double stddev = max(sqrt(max(variance, 0.0)), max(PHI_MIN_STDDEV, mean / 2));
+    double later = 0.5 * erfc((elapsed - mean) / (stddev * sqrt(2.0)));
+    // erfc underflows to 0 far in the tail, which is certainty anyway
+    return later > 0 ? -log10(later) : 1000;
+}
 //Ŀ
 //update_src_memberУһ֪Ľڵ㷢Ϣǰڵʱ
 // ȷʵӸýڵڵǰڵԱбм¼src_member->heartbeat++
@@ -449,6 +1317,7 @@ void MP1Node::update_src_member(MessageHdr* msg) {
  * 				Propagate your membership list
  */
 void MP1Node::nodeLoopOps() {
+    answer_joins();
 
 	/*
 	 * Your code goes here
@@ -458,6 +1327,14 @@ void MP1Node::nodeLoopOps() {
        ûзµϢܻᱻΪʧЧڵĳԱб
        Ƴ
 	 */
+    if (!tombstones.empty()) {
+        sweep_tombstones();
+    }
+    // SWIM probes instead of heartbeats; the heartbeat stays the incarnation number
+    if (par->DETECTOR == SWIM_DETECTOR) {
+        swim_tick();
+        return;
+    }
      // Update heartbeat
     memberNode->heartbeat++;
     // Check TREMOVE
@@ -465,27 +1342,619 @@ void MP1Node::nodeLoopOps() {
     //ѭԱбÿڵʱĳڵϴνյʱ䳬
     // TREMOVEֵζŽڵѾʧܻ뿪磬ҪӳԱб
     // Ƴ
-    for (int i = memberNode->memberList.size() - 1; i >= 0; i--) {
-        if (par->getcurrtime() - memberNode->memberList[i].timestamp >= TREMOVE) {
-            Address* removed_addr = get_address(memberNode->memberList[i].id, memberNode->memberList[i].port);
-            log->logNodeRemove(&memberNode->addr, removed_addr);
-            memberNode->memberList.erase(memberNode->memberList.begin() + i);
-            delete removed_addr;
+    // The phi detector removes on PHI_THRESHOLD instead
+    if (par->DETECTOR == PHI_DETECTOR) {
+        for (int i = memberNode->memberList.size() - 1; i >= 0; i--) {
+            MemberListEntry& e = memberNode->memberList[i];
+            if (phi(e.id, e.port) > par->PHI_THRESHOLD) {
+                expire_member(i);
+            }
+        }
+    }
+    else if (!memberSeen.empty()) {
+        // Backwards, so the entry moved into a removed slot has already been checked
+        expired.resize(memberSeen.size());
+        int n = sweep_expired(&memberSeen[0], memberSeen.size(), par->getcurrtime() - par->T_REMOVE * health_scale(), &expired[0]);
+        for (int k = n - 1; k >= 0; k--) {
+            expire_member(expired[k]);
         }
     }
 
     // Send PING to the members of memberList
     //ٴαԱбÿԱڵ㷢ϢǷֲʽϵͳнڵ໥Ļơ
     //ͨϢڵԸ֪еڵȻԾ
-    for (int i = 0; i < memberNode->memberList.size(); i++) {
-        Address* address = get_address(memberNode->memberList[i].id, memberNode->memberList[i].port);
-        send_message(address, PING);
-        delete address;
+    // In gossip mode only every GOSSIP_INTERVAL ticks, staggered by node id
+    int id = *(int*)(&memberNode->addr.addr);
+    // Deltas lost to drops are repaired by a push-pull with one random member.
+    // Only a digest goes out; the whole lists follow if the views differ.
+    // With zones, a node reaches outside its own zone only every ZONE_CROSS rounds.
+    if (par->GOSSIP_DELTA > 0 && (par->getcurrtime() + id) % par->GOSSIP_SYNC == 0 && !memberNode->memberList.empty()) {
+        bool cross = ((par->getcurrtime() + id) / par->GOSSIP_SYNC) % par->ZONE_CROSS == 0;
+        MemberListEntry& peer = memberNode->memberList[gossip_targets(1, cross)[0]];
+        Address* peer_addr = get_address(peer.id, peer.port);
+        char* buffer = build_digest();
+        emulNet->ENsendBuffer(&memberNode->addr, peer_addr, buffer);
+        emulNet->ENrelease(buffer);
+        delete peer_addr;
+    }
+    if ((par->getcurrtime() + id) % par->GOSSIP_INTERVAL != 0) {
+        return;
+    }
+
+    // One PING buffer is shared by every target: GOSSIP_FANOUT random members, or all of them
+    int n = memberNode->memberList.size();
+    int k = (par->GOSSIP_FANOUT > 0 && par->GOSSIP_FANOUT < n) ? par->GOSSIP_FANOUT : n;
+    bool cross = ((par->getcurrtime() + id) / par->GOSSIP_INTERVAL) % par->ZONE_CROSS == 0;
+    vector<int> order = gossip_targets(k, cross);
+    // A peer that sent us KV traffic lately gets our heartbeat on the replies, it sits the round out
+    if (par->PIGGYBACK > 0 && !kvHeard.empty()) {
+        int kept = 0;
+        for (int i = 0; i < k; i++) {
+            MemberListEntry& e = memberNode->memberList[order[i]];
+            unordered_map<long, int>::iterator it = kvHeard.find(member_key(e.id, e.port));
+            if (it == kvHeard.end() || par->getcurrtime() - it->second >= par->PIGGYBACK) {
+                order[kept++] = order[i];
+            }
+        }
+        k = kept;
+        order.resize(k);
+        if (k == 0) {
+            return;
+        }
+    }
+    vector<Address> targets(k);
+    for (int i = 0; i < k; i++) {
+        memcpy(&targets[i].addr[0], &memberNode->memberList[order[i]].id, sizeof(int));
+        memcpy(&targets[i].addr[4], &memberNode->memberList[order[i]].port, sizeof(short));
+    }
+    if (par->GOSSIP_DELTA <= 0) {
+        char* buffer = build_message(PING);
+        emulNet->ENmulticast(&memberNode->addr, targets, buffer);
+        emulNet->ENrelease(buffer);
+        return;
+    }
+
+    // Delta gossip: a target gets the entries changed since it was last gossiped to.
+    // Targets last gossiped to at the same tick share one buffer.
+    map<int, vector<Address> > groups;
+    for (int i = 0; i < k; i++) {
+        long key = member_key(memberNode->memberList[order[i]].id, memberNode->memberList[order[i]].port);
+        unordered_map<long, int>::iterator it = peerSynced.find(key);
+        groups[it == peerSynced.end() ? -1 : it->second].push_back(targets[i]);
+        peerSynced[key] = par->getcurrtime();
+    }
+    for (map<int, vector<Address> >::iterator it = groups.begin(); it != groups.end(); it++) {
+        char* buffer = build_message(PING, it->first);
+        emulNet->ENmulticast(&memberNode->addr, it->second, buffer);
+        emulNet->ENrelease(buffer);
     }
 
     return;
 }
 
+/**
+ * FUNCTION NAME: swim_tick
+ *
+ * DESCRIPTION: One tick of the SWIM detector.
+ * 				Suspects whose suspicion timed out are confirmed dead. The timeout is T_REMOVE ticks,
+ * 				or log2(n) periods in larger groups.
+ * 				The member probed this period is asked for by SWIM_PROBES others once SWIM_TIMEOUT
+ * 				ticks pass without an ACK, and suspected if the period ends without one.
+ * 				Every SWIM_PERIOD ticks, at least three SWIM_TIMEOUTs, the next member in round robin order is probed.
+ * 				All three stretch by health_scale while this node is behind, and with LOCAL_HEALTH
+ * 				the suspicion timeout also depends on how many members confirm it, see swim_suspicion.
+ */
+void MP1Node::swim_tick() {
+    int now = par->getcurrtime();
+    // The indirect round trip is twice the direct one, the period must leave room for it
+    // A node that is behind waits longer for ACKs and probes less often, scaled by its local health
+    int timeout = par->SWIM_TIMEOUT * health_scale();
+    int period = max(par->SWIM_PERIOD * health_scale(), 3 * timeout);
+    // A suspect needs about log2(n) periods to hear of its suspicion and refute it
+    int suspicion = max(par->T_REMOVE * health_scale(), (int)ceil(log2(memberNode->memberList.size() + 1)) * period);
+
+    vector<long> expired;
+    for (unordered_map<long, Suspicion>::iterator it = suspects.begin(); it != suspects.end(); it++) {
+        if (now - it->second.start >= swim_suspicion(it->second, suspicion)) {
+            expired.push_back(it->first);
+        }
+    }
+    for (int i = 0; i < (int)expired.size(); i++) {
+        MemberListEntry* e = check_member_list((int)(expired[i] >> 16), (short)(expired[i] & 0xffff));
+        if (e != nullptr) {
+            swim_confirm(e->id, e->port, e->heartbeat);
+        }
+        suspects.erase(expired[i]);
+    }
+
+    MemberListEntry* target = probeTarget ? check_member_list(probeTarget, probePort) : nullptr;
+    if (target != nullptr && !probeAcked && !probeIndirect && now - probeStart >= timeout) {
+        // Ask others to probe it, in case only the path from here is lossy
+        Address* to = get_address(probeTarget, probePort);
+        int n = memberNode->memberList.size();
+        vector<int> order = sample_members(min(par->SWIM_PROBES + 1, n));
+        int asked = 0;
+        for (int i = 0; i < (int)order.size() && asked < par->SWIM_PROBES; i++) {
+            MemberListEntry& helper = memberNode->memberList[order[i]];
+            if (helper.id == probeTarget && helper.port == probePort) {
+                continue;
+            }
+            Address* helperAddr = get_address(helper.id, helper.port);
+            swim_send(helperAddr, PINGREQ, to, &memberNode->addr, probeSeq);
+            delete helperAddr;
+            asked++;
+        }
+        delete to;
+        probeIndirect = true;
+    }
+
+    if (probeTarget == 0 || now - probeStart >= period) {
+        if (target != nullptr && !probeAcked) {
+            swim_suspect(target);
+        }
+        swim_probe();
+    }
+}
+
+/**
+ * FUNCTION NAME: swim_probe
+ *
+ * DESCRIPTION: Send a PROBE to the next member in round robin order. The order is reshuffled
+ * 				after every pass, so each member is probed once per pass in random order.
+ */
+void MP1Node::swim_probe() {
+    probeTarget = 0;
+    probeStart = par->getcurrtime();
+    for (int pass = 0; pass < 2 && probeTarget == 0; pass++) {
+        if (probeNext >= (int)probeOrder.size()) {
+            int n = memberNode->memberList.size();
+            vector<int> order = sample_members(n > 0 ? n - 1 : 0);
+            // sample_members shuffles only when asked for fewer than all, place the last one too
+            if (n > 0) {
+                vector<char> taken(n, 0);
+                for (int i = 0; i < (int)order.size(); i++) {
+                    taken[order[i]] = 1;
+                }
+                for (int i = 0; i < n; i++) {
+                    if (!taken[i]) {
+                        order.push_back(i);
+                    }
+                }
+            }
+            probeOrder.clear();
+            for (int i = 0; i < (int)order.size(); i++) {
+                probeOrder.push_back(make_pair(memberNode->memberList[order[i]].id, memberNode->memberList[order[i]].port));
+            }
+            probeNext = 0;
+        }
+        while (probeNext < (int)probeOrder.size()) {
+            pair<int, short> next = probeOrder[probeNext++];
+            if (check_member_list(next.first, next.second) != nullptr) {
+                probeTarget = next.first;
+                probePort = next.second;
+                break;
+            }
+        }
+    }
+    if (probeTarget == 0) {
+        return;
+    }
+
+    probeSeq++;
+    probeAcked = false;
+    probeIndirect = false;
+    Address* to = get_address(probeTarget, probePort);
+    swim_send(to, PROBE, to, &memberNode->addr, probeSeq);
+    delete to;
+}
+
+/**
+ * FUNCTION NAME: swim_send
+ *
+ * DESCRIPTION: Send a SWIM message carrying the newest SWIM_PIGGYBACK updates of the
+ * 				dissemination buffer. Updates that have ridden on enough messages leave the buffer.
+ * 				Wire format, every integer a varint:
+ * 				type byte, sender id, port and incarnation, target id and port, origin id and port,
+ * 				seq, count, then per update: id, port, status byte, incarnation, suspecter id.
+ */
+void MP1Node::swim_send(Address* toaddr, MsgTypes t, Address* target, Address* origin, int seq) {
+    int count = min((int)gossip.size(), par->SWIM_PIGGYBACK);
+
+    // News about the destination goes first, so a suspect hears of it from the next message it gets
+    int to = 0;
+    short toport = 0;
+    memcpy(&to, &toaddr->addr[0], sizeof(int));
+    memcpy(&toport, &toaddr->addr[4], sizeof(short));
+    for (int i = 1; i < (int)gossip.size(); i++) {
+        if (gossip[i].update.id == to && gossip[i].update.port == toport) {
+            SwimGossip g = gossip[i];
+            gossip.erase(gossip.begin() + i);
+            gossip.push_front(g);
+            break;
+        }
+    }
+
+    Address* addrs[3] = { &memberNode->addr, target, origin };
+    int size = 1 + varint_size(memberNode->heartbeat) + varint_size(seq) + varint_size(count);
+    for (int a = 0; a < 3; a++) {
+        size += varint_size(*(int*)&addrs[a]->addr[0]) + varint_size(*(unsigned short*)&addrs[a]->addr[4]);
+    }
+    for (int i = 0; i < count; i++) {
+        SwimUpdate& u = gossip[i].update;
+        size += varint_size(u.id) + varint_size((unsigned short)u.port) + 1 + varint_size(u.incarnation) + varint_size(u.from);
+    }
+
+    char* buffer = emulNet->ENalloc(size);
+    char* out = buffer;
+    *out++ = (char)t;
+    out = put_varint(out, *(int*)&memberNode->addr.addr[0]);
+    out = put_varint(out, *(unsigned short*)&memberNode->addr.addr[4]);
+    out = put_varint(out, memberNode->heartbeat);
+    for (int a = 1; a < 3; a++) {
+        out = put_varint(out, *(int*)&addrs[a]->addr[0]);
+        out = put_varint(out, *(unsigned short*)&addrs[a]->addr[4]);
+    }
+    out = put_varint(out, seq);
+    out = put_varint(out, count);
+    for (int i = 0; i < count; i++) {
+        SwimUpdate& u = gossip[i].update;
+        out = put_varint(out, u.id);
+        out = put_varint(out, (unsigned short)u.port);
+        *out++ = (char)u.status;
+        out = put_varint(out, u.incarnation);
+        out = put_varint(out, u.from);
+        gossip[i].sends--;
+    }
+    for (int i = count - 1; i >= 0; i--) {
+        if (gossip[i].sends <= 0) {
+            gossip.erase(gossip.begin() + i);
+        }
+    }
+
+    emulNet->ENsendBuffer(&memberNode->addr, toaddr, buffer);
+    emulNet->ENrelease(buffer);
+}
+
+/**
+ * FUNCTION NAME: decode_swim
+ *
+ * DESCRIPTION: Decode a message written by swim_send into msg and decodedUpdates
+ *
+ * RETURNS:
+ * false if the message is truncated
+ */
+bool MP1Node::decode_swim(char* data, int size, SwimHdr* msg) {
+    const char* in = data + 1;
+    const char* end = data + size;
+    Address* addrs[3] = { &msg->addr, &msg->target, &msg->origin };
+    unsigned long id, port, incarnation, seq, count;
+
+    msg->msgType = (MsgTypes)data[0];
+    for (int a = 0; a < 3; a++) {
+        if (!(in = get_varint(in, end, &id)) || !(in = get_varint(in, end, &port))) {
+            return false;
+        }
+        int node = id;
+        short node_port = port;
+        memset(addrs[a]->addr, 0, sizeof(addrs[a]->addr));
+        memcpy(&addrs[a]->addr[0], &node, sizeof(int));
+        memcpy(&addrs[a]->addr[4], &node_port, sizeof(short));
+        if (a == 0 && !(in = get_varint(in, end, &incarnation))) {
+            return false;
+        }
+    }
+    // An update takes at least four bytes, so a larger count cannot be genuine
+    if (!(in = get_varint(in, end, &seq)) || !(in = get_varint(in, end, &count)) || count > (unsigned long)(end - in) / 4) {
+        return false;
+    }
+    msg->incarnation = incarnation;
+    msg->seq = seq;
+    msg->count = count;
+
+    decodedUpdates.resize(count);
+    for (unsigned long i = 0; i < count; i++) {
+        if (!(in = get_varint(in, end, &id)) || !(in = get_varint(in, end, &port)) || in >= end) {
+            return false;
+        }
+        SwimUpdate& u = decodedUpdates[i];
+        u.id = id;
+        u.port = port;
+        u.status = (unsigned char)*in++;
+        if (!(in = get_varint(in, end, &incarnation)) || !(in = get_varint(in, end, &id))) {
+            return false;
+        }
+        u.incarnation = incarnation;
+        u.from = id;
+    }
+    return true;
+}
+
+/**
+ * FUNCTION NAME: swim_handler
+ *
+ * DESCRIPTION: Apply the updates piggybacked on a SWIM message, and learn of the sender
+ * 				if it joined without this node hearing about it or moved to a newer incarnation. Then
+ * 				PROBE: answer the sender with an ACK
+ * 				PINGREQ: probe the target on behalf of the origin
+ * 				ACK: close the current probe if this node started it, otherwise pass it on to the origin
+ */
+void MP1Node::swim_handler(SwimHdr* msg) {
+    SwimUpdate* updates = decodedUpdates.empty() ? nullptr : &decodedUpdates[0];
+    for (int i = 0; i < msg->count; i++) {
+        swim_apply(&updates[i]);
+    }
+    // A sender that refuted a suspicion says so itself, before its refutation reaches us by gossip
+    MemberListEntry* known = check_member_list(&msg->addr);
+    if (known == nullptr || msg->incarnation > known->heartbeat) {
+        SwimUpdate sender;
+        memcpy(&sender.id, &msg->addr.addr[0], sizeof(int));
+        memcpy(&sender.port, &msg->addr.addr[4], sizeof(short));
+        sender.status = ALIVE;
+        sender.incarnation = msg->incarnation;
+        sender.from = 0;
+        swim_apply(&sender);
+    }
+
+    if (msg->msgType == PROBE) {
+        swim_send(&msg->addr, ACK, &memberNode->addr, &msg->origin, msg->seq);
+    }
+    else if (msg->msgType == PINGREQ) {
+        swim_send(&msg->target, PROBE, &msg->target, &msg->origin, msg->seq);
+    }
+    else if (msg->msgType == ACK) {
+        if (msg->origin == memberNode->addr) {
+            int id = 0;
+            memcpy(&id, &msg->target.addr[0], sizeof(int));
+            if (msg->seq == probeSeq && id == probeTarget) {
+                probeAcked = true;
+            }
+            else if (msg->seq < probeSeq) {
+                // The ACK of a probe whose period is over, we are slow to handle it
+                health_event(1);
+            }
+        }
+        else {
+            swim_send(&msg->origin, ACK, &msg->target, &msg->origin, msg->seq);
+        }
+    }
+}
+
+/**
+ * FUNCTION NAME: swim_priority
+ *
+ * DESCRIPTION: How soon a slow node must handle a SWIM message:
+ * 				0 if it carries a suspicion of this node, which the node must refute,
+ * 				1 for a PROBE or PINGREQ, whose prober is waiting on the answer,
+ * 				2 for anything else
+ */
+int MP1Node::swim_priority(char* data, int size) {
+    SwimHdr msg;
+    if (size <= 0 || (data[0] != PROBE && data[0] != PINGREQ && data[0] != ACK) || !decode_swim(data, size, &msg)) {
+        return 2;
+    }
+    int id = *(int*)(&memberNode->addr.addr);
+    short port = *(short*)(&memberNode->addr.addr[4]);
+    for (int i = 0; i < msg.count; i++) {
+        SwimUpdate& u = decodedUpdates[i];
+        if (u.id == id && u.port == port && u.status != ALIVE) {
+            return 0;
+        }
+    }
+    return msg.msgType == ACK ? 2 : 1;
+}
+
+/**
+ * FUNCTION NAME: swim_prioritize
+ *
+ * DESCRIPTION: Reorder mp1q by swim_priority, keeping the order of messages of equal priority.
+ * 				Called when the budget of an overloaded node will not drain the queue, so the node
+ * 				refutes suspicions and answers its probers before it gets to the rest, Lifeguard style.
+ */
+void MP1Node::swim_prioritize() {
+    queue<q_elt> ranked[3];
+    while (!memberNode->mp1q.empty()) {
+        q_elt& m = memberNode->mp1q.front();
+        ranked[swim_priority((char*)m.elt, m.size)].push(m);
+        memberNode->mp1q.pop();
+    }
+    for (int r = 0; r < 3; r++) {
+        while (!ranked[r].empty()) {
+            memberNode->mp1q.push(ranked[r].front());
+            ranked[r].pop();
+        }
+    }
+}
+
+/**
+ * FUNCTION NAME: swim_join_reply
+ *
+ * DESCRIPTION: A joining node takes the introducer's whole member list from its JOINREP.
+ * 				SWIM only disseminates changes, so nobody would tell it about quiet members later.
+ */
+void MP1Node::swim_join_reply(MessageHdr* msg) {
+    MemberListEntry* entries = member_entries(msg);
+    push_member_list(msg);
+    for (int i = 0; i < msg->count; i++) {
+        Address* addr = get_address(entries[i].id, entries[i].port);
+        if (!(*addr == memberNode->addr) && check_member_list(entries[i].id, entries[i].port) == nullptr) {
+            MemberListEntry e(entries[i].id, entries[i].port, entries[i].heartbeat, par->getcurrtime());
+            add_member(e);
+            log->logNodeAdd(&memberNode->addr, addr);
+        }
+        delete addr;
+    }
+    memberNode->inGroup = true;
+}
+
+/**
+ * FUNCTION NAME: swim_apply
+ *
+ * DESCRIPTION: Merge one piggybacked update into the member list. A higher incarnation
+ * 				overrides anything; at equal incarnation SUSPECT overrides ALIVE and DEAD overrides both.
+ * 				News that changed something is passed on. A node suspected itself refutes it
+ * 				by moving to a higher incarnation.
+ */
+void MP1Node::swim_apply(SwimUpdate* u) {
+    int id = *(int*)(&memberNode->addr.addr);
+    short port = *(short*)(&memberNode->addr.addr[4]);
+    if (u->id == id && u->port == port) {
+        if (u->status != ALIVE && u->incarnation >= memberNode->heartbeat) {
+            // Being suspected is a sign we are not answering in time
+            health_event(1);
+            memberNode->heartbeat = u->incarnation + 1;
+            swim_enqueue(id, port, ALIVE, memberNode->heartbeat);
+        }
+        return;
+    }
+
+    MemberListEntry* e = check_member_list(u->id, u->port);
+    if (u->status == ALIVE) {
+        if (e == nullptr) {
+            if (check_tombstone(u->id, u->port, u->incarnation)) {
+                return;
+            }
+            MemberListEntry added(u->id, u->port, u->incarnation, par->getcurrtime());
+            add_member(added);
+            Address* addr = get_address(u->id, u->port);
+            log->logNodeAdd(&memberNode->addr, addr);
+            delete addr;
+        }
+        else if (u->incarnation > e->heartbeat) {
+            e->heartbeat = u->incarnation;
+            e->timestamp = par->getcurrtime();
+            suspects.erase(member_key(u->id, u->port));
+        }
+        else {
+            return;
+        }
+        swim_enqueue(u->id, u->port, ALIVE, u->incarnation);
+    }
+    else if (u->status == SUSPECT) {
+        if (e == nullptr || u->incarnation < e->heartbeat) {
+            return;
+        }
+        unordered_map<long, Suspicion>::iterator it = suspects.find(member_key(u->id, u->port));
+        if (u->incarnation == e->heartbeat && it != suspects.end()) {
+            // Already suspect, but another member confirming it is news too
+            if (swim_confirmed(it->second, u->from)) {
+                swim_enqueue(u->id, u->port, SUSPECT, u->incarnation, u->from);
+            }
+            return;
+        }
+        e->heartbeat = u->incarnation;
+        e->timestamp = par->getcurrtime();
+        Suspicion& s = suspects[member_key(u->id, u->port)];
+        s.start = par->getcurrtime();
+        s.from.assign(1, u->from);
+        swim_enqueue(u->id, u->port, SUSPECT, u->incarnation, u->from);
+    }
+    else if (u->status == DEAD) {
+        if (e != nullptr && u->incarnation >= e->heartbeat) {
+            swim_confirm(u->id, u->port, u->incarnation);
+        }
+        else if (e == nullptr) {
+            add_tombstone(u->id, u->port, u->incarnation);
+        }
+    }
+}
+
+/**
+ * FUNCTION NAME: swim_suspect
+ *
+ * DESCRIPTION: Suspect a member that missed its probe and tell the group.
+ * 				If it is suspect already, this node confirms the suspicion instead.
+ */
+void MP1Node::swim_suspect(MemberListEntry* e) {
+    int self = *(int*)(&memberNode->addr.addr);
+    unordered_map<long, Suspicion>::iterator it = suspects.find(member_key(e->id, e->port));
+    if (it != suspects.end()) {
+        if (swim_confirmed(it->second, self)) {
+            swim_enqueue(e->id, e->port, SUSPECT, e->heartbeat, self);
+        }
+        return;
+    }
+    Suspicion& s = suspects[member_key(e->id, e->port)];
+    s.start = par->getcurrtime();
+    s.from.assign(1, self);
+    swim_enqueue(e->id, e->port, SUSPECT, e->heartbeat, self);
+}
+
+/**
+ * FUNCTION NAME: swim_confirmed
+ *
+ * DESCRIPTION: Count member from as one more independent suspecter of s. Only kept with LOCAL_HEALTH.
+ *
+ * RETURNS:
+ * true if from is new and counted, so the confirmation is worth passing on
+ */
+bool MP1Node::swim_confirmed(Suspicion& s, int from) {
+    if (par->LOCAL_HEALTH <= 0 || from == 0 || (int)s.from.size() > SUSPICION_CONFIRM ||
+        find(s.from.begin(), s.from.end(), from) != s.from.end()) {
+        return false;
+    }
+    s.from.push_back(from);
+    return true;
+}
+
+/**
+ * FUNCTION NAME: swim_suspicion
+ *
+ * DESCRIPTION: Ticks suspicion s lasts before its member is confirmed dead, given the plain timeout.
+ * 				With LOCAL_HEALTH, Lifeguard style, a suspicion raised by one member lasts SUSPICION_MULT
+ * 				times as long, and falls back to timeout logarithmically as SUSPICION_CONFIRM others confirm it.
+ * 				A crashed member is soon suspected by many; a slow one is suspected by few and has time to refute.
+ */
+int MP1Node::swim_suspicion(Suspicion& s, int timeout) {
+    if (par->LOCAL_HEALTH <= 0) {
+        return timeout;
+    }
+    int longest = SUSPICION_MULT * timeout;
+    int confirmations = max(0, (int)s.from.size() - 1);
+    double progress = log2(confirmations + 1) / log2(SUSPICION_CONFIRM + 1);
+    return max(timeout, (int)(longest - (longest - timeout) * progress));
+}
+
+/**
+ * FUNCTION NAME: swim_confirm
+ *
+ * DESCRIPTION: Remove a member confirmed dead and tell the group
+ */
+void MP1Node::swim_confirm(int id, short port, long incarnation) {
+    unordered_map<long, int>::iterator it = memberIndex.find(member_key(id, port));
+    if (it != memberIndex.end()) {
+        Address* removed_addr = get_address(id, port);
+        log->logNodeRemove(&memberNode->addr, removed_addr);
+        remove_member(it->second);
+        delete removed_addr;
+    }
+    suspects.erase(member_key(id, port));
+    add_tombstone(id, port, incarnation);
+    swim_enqueue(id, port, DEAD, incarnation);
+}
+
+/**
+ * FUNCTION NAME: swim_enqueue
+ *
+ * DESCRIPTION: Put an update at the front of the dissemination buffer, replacing older news
+ * 				about the same member. It rides on 3 log2(n) messages, enough to reach
+ * 				every member with high probability.
+ */
+void MP1Node::swim_enqueue(int id, short port, short status, long incarnation, int from) {
+    for (int i = gossip.size() - 1; i >= 0; i--) {
+        if (gossip[i].update.id == id && gossip[i].update.port == port) {
+            gossip.erase(gossip.begin() + i);
+        }
+    }
+    SwimGossip g;
+    g.update.id = id;
+    g.update.port = port;
+    g.update.status = status;
+    g.update.incarnation = incarnation;
+    g.update.from = from;
+    g.sends = 3 * (int)ceil(log2(memberNode->memberList.size() + 2));
+    gossip.push_front(g);
+}
+
 /**
  * FUNCTION NAME: isNullAddress
  *
@@ -498,13 +1967,18 @@ int MP1Node::isNullAddress(Address *addr) {
 /**
  * FUNCTION NAME: getJoinAddress
  *
- * DESCRIPTION: Returns the Address of the coordinator
+ * DESCRIPTION: Returns the Address of the coordinator.
+ * 				The introducers are ids 1 to INTRODUCERS. A node joins through a random one of them,
+ * 				an introducer through one started before it, so the join load is spread out.
+ * 				Node 1 gets its own address and boots the group.
  */
 Address MP1Node::getJoinAddress() {
     Address joinaddr;
+    int id = *(int*)(&memberNode->addr.addr);
+    int seeds = min(par->INTRODUCERS, max(id - 1, 1));
 
     memset(&joinaddr, 0, sizeof(Address));
-    *(int *)(&joinaddr.addr) = 1;
+    *(int *)(&joinaddr.addr) = 1 + rand() % seeds;
     *(short *)(&joinaddr.addr[4]) = 0;
 
     return joinaddr;
@@ -517,6 +1991,16 @@ Address MP1Node::getJoinAddress() {
  */
 void MP1Node::initMemberListTable(Member *memberNode) {
 	memberNode->memberList.clear();
+	memberIndex.clear();
+	memberVersion.clear();
+	memberSeen.clear();
+	memberDigest = digest_key(member_key(*(int*)(&memberNode->addr.addr), *(short*)(&memberNode->addr.addr[4])));
+	peerSynced.clear();
+	arrivals.clear();
+	tombstones.clear();
+	kvHeard.clear();
+	health = 0;
+	publish_change();
 }
 
 /**
@@ -14,12 +14,28 @@
 #include "Member.h"
 #include "EmulNet.h"
 #include "Queue.h"
+#include <unordered_map>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 /**
  * Macros
  */
-#define TREMOVE 20
-#define TFAIL 5
+// TFAIL and TREMOVE are read from the config file, see Params::T_FAIL and Params::T_REMOVE
+// Heartbeat intervals the phi detector remembers per member
+#define PHI_WINDOW 16
+// Intervals needed before phi is trusted over T_REMOVE
+#define PHI_MIN_SAMPLES 8
+// Floor of the interval standard deviation in ticks, raised to half the mean interval,
+// so a regular member is not suspected the moment one heartbeat is late
+#define PHI_MIN_STDDEV 1.0
+// Changed member entries carried by the piggyback on one KV message
+#define PIGGYBACK_ENTRIES 4
+// Lifeguard suspicion, used when LOCAL_HEALTH is set: a suspicion raised by one member lasts
+// SUSPICION_MULT times the SWIM suspicion timeout, and shrinks back to it as SUSPICION_CONFIRM others confirm it
+#define SUSPICION_MULT 6
+#define SUSPICION_CONFIRM 3
 
 /*
  * Note: You can change/add any functions in MP1Node.{h,cpp}
@@ -33,28 +49,140 @@ enum MsgTypes{
     JOINREP,
     DUMMYLASTMSGTYPE,
 	//add new thing
-	PING
+	PING,
+	// SWIM detector
+	PROBE,
+	ACK,
+	PINGREQ,
+	// Delta gossip push-pull, answered with a whole list PING
+	SYNC,
+	// Graceful leave, carries the leaving member
+	LEAVE,
+	// Delta gossip anti-entropy: digest of the sender's view, answered with a SYNC if ours differs
+	DIGEST
+};
+
+/**
+ * State of a member as the SWIM detector sees it
+ */
+enum SwimStatus {
+	ALIVE,
+	SUSPECT,
+	DEAD
 };
 
 /**
  * STRUCT NAME: MessageHdr
  *
- * DESCRIPTION: Header and content of a message
+ * DESCRIPTION: Header of a decoded message. On the wire the header and the sender's
+ * 				member list are varint encoded, see MP1Node::build_message.
  */
 typedef struct MessageHdr {
 	enum MsgTypes msgType;
-
-	//add new things;
-	vector<MemberListEntry> member_vector;
+	// Sender and its own heartbeat
+	Address addr;
+	long heartbeat;
+	// Number of MemberListEntry records following the header
 	/**
 		ڵΨһʶIDIPַ
 		ڵĶ˿ں
 		ڵֵ
 		ڵһθʱ䣨ʱ
 		**/
-	Address* addr;
+	int count;
+	// DIGEST only: members in the sender's view, itself included, and their digest
+	int members;
+	unsigned long digest;
 }MessageHdr;
 
+/**
+ * STRUCT NAME: SwimHdr
+ *
+ * DESCRIPTION: Header of a decoded SWIM PROBE, ACK or PINGREQ, followed on the wire by
+ * 				count updates. See MP1Node::swim_send for the encoding.
+ */
+typedef struct SwimHdr {
+	enum MsgTypes msgType;
+	// Sender and its incarnation
+	Address addr;
+	long incarnation;
+	// Member being probed
+	Address target;
+	// Member that started the probe, the ACK travels back to it
+	Address origin;
+	// Probe number of origin, so a late ACK does not answer a newer probe
+	int seq;
+	int count;
+}SwimHdr;
+
+/**
+ * STRUCT NAME: SwimUpdate
+ *
+ * DESCRIPTION: Membership change piggybacked on SWIM traffic.
+ * 				The incarnation of a member is the heartbeat of its entry.
+ */
+typedef struct SwimUpdate {
+	int id;
+	short port;
+	short status;
+	long incarnation;
+	// Member that raised a SUSPECT, 0 for other updates
+	int from;
+}SwimUpdate;
+
+/**
+ * STRUCT NAME: Suspicion
+ *
+ * DESCRIPTION: A suspected member: the tick it became suspect and the distinct members that
+ * 				suspected it at its current incarnation, up to SUSPICION_CONFIRM + 1
+ */
+typedef struct Suspicion {
+	int start;
+	vector<int> from;
+}Suspicion;
+
+/**
+ * STRUCT NAME: SwimGossip
+ *
+ * DESCRIPTION: Update waiting in the dissemination buffer, and how many more messages it rides on
+ */
+typedef struct SwimGossip {
+	SwimUpdate update;
+	int sends;
+}SwimGossip;
+
+/**
+ * STRUCT NAME: PhiWindow
+ *
+ * DESCRIPTION: The last PHI_WINDOW intervals between heartbeat advances of one member
+ */
+typedef struct PhiWindow {
+	// Tick the heartbeat last advanced
+	int last;
+	// Intervals held, and the slot the next one replaces
+	int count;
+	int next;
+	int intervals[PHI_WINDOW];
+	double sum;
+	double sumSq;
+}PhiWindow;
+
+/**
+ * Called with the new membership version each time the member set of a node changes
+ */
+typedef void (*MembershipListener)(void *env, long version);
+
+/**
+ * STRUCT NAME: Tombstone
+ *
+ * DESCRIPTION: A removed member: the heartbeat (incarnation under SWIM) it was removed at,
+ * 				and the tick the tombstone expires
+ */
+typedef struct Tombstone {
+	long heartbeat;
+	int expires;
+}Tombstone;
+
 /**
  * CLASS NAME: MP1Node
  *
@@ -67,18 +195,69 @@ private:
 	Params *par;
 	Member *memberNode;
 	char NULLADDR[6];
+	// Position of each member in memberList, keyed by member_key
+	unordered_map<long, int> memberIndex;
+	// Delta gossip: tick each memberList entry last changed, kept parallel to memberList,
+	// and tick each peer was last gossiped to, keyed by member_key
+	vector<int> memberVersion;
+	unordered_map<long, int> peerSynced;
+	// Timestamp of each memberList entry under the heartbeat detector, kept parallel to memberList
+	// as a plain column so the T_REMOVE sweep compares four at a time, and the positions it found expired
+	vector<int> memberSeen;
+	vector<int> expired;
+	// Joiners whose JOINREQ arrived since the last round, answered together with one JOINREP
+	vector<Address> pendingJoins;
+	// Piggyback on KV traffic: this tick's encoding, the tick it was built at,
+	// and the tick each peer was last heard from through KV traffic, keyed by member_key
+	string piggybackCache;
+	int piggybackTick;
+	unordered_map<long, int> kvHeard;
+	// Local health, 0 when this node keeps up, raised each time it falls behind on its queue,
+	// answers an old probe late or has to refute a suspicion about itself, up to LOCAL_HEALTH
+	int health;
+	// Order independent digest of this node and its members, kept up to date by add_member and remove_member
+	unsigned long memberDigest;
+	// Phi detector: heartbeat intervals of each member
+	unordered_map<long, PhiWindow> arrivals;
+	// Recently removed members, keyed by member_key. Gossip no newer than the tombstone
+	// does not bring them back.
+	unordered_map<long, Tombstone> tombstones;
+	// Advanced on every change to the member set, and who is told when it does
+	long membershipVersion;
+	vector< pair<MembershipListener, void *> > listeners;
+	// Member list or updates of the message being handled, reused from message to message
+	vector<MemberListEntry> decodedEntries;
+	vector<SwimUpdate> decodedUpdates;
+	// SWIM probe of the current period; probeTarget is 0 when there is none
+	int probeSeq;
+	int probeTarget;
+	short probePort;
+	int probeStart;
+	bool probeAcked;
+	bool probeIndirect;
+	// Members in shuffled round robin order, probed one per period
+	vector< pair<int, short> > probeOrder;
+	int probeNext;
+	// Suspicion of each suspected member, by member_key
+	unordered_map<long, Suspicion> suspects;
+	// Dissemination buffer, newest update first
+	deque<SwimGossip> gossip;
 
 public:
 	MP1Node(Member *, Params *, EmulNet *, Log *, Address *);
 	Member * getMemberNode() {
 		return memberNode;
 	}
+	long getMembershipVersion() {
+		return membershipVersion;
+	}
+	void subscribe(MembershipListener listener, void *env);
 	int recvLoop();
 	static int enqueueWrapper(void *env, char *buff, int size);
 	void nodeStart(char *servaddrstr, short serverport);
 	int initThisNode(Address *joinaddr);
 	int introduceSelfToGroup(Address *joinAddress);
-	int finishUpThisNode();
+	int finishUpThisNode(bool announce = true);
 	void nodeLoop();
 	void checkMessages();
 	bool recvCallBack(void *env, char *data, int size);
@@ -92,17 +271,67 @@ public:
 	//new add
 	void push_member_list(MessageHdr* msg);
 	void push_member_list(MemberListEntry* e);
+	void answer_joins();
 
 	MemberListEntry* check_member_list(int id, short port);
 	MemberListEntry* check_member_list(Address* node_addr);
+	static long member_key(int id, short port);
+	void add_member(MemberListEntry& e);
+	void remove_member(int i);
+	void expire_member(int i);
+	static int sweep_expired(const int* seen, int n, int deadline, int* out);
+	void add_tombstone(int id, short port, long heartbeat);
+	bool check_tombstone(int id, short port, long heartbeat);
+	void sweep_tombstones();
+	void publish_change();
 
 	void send_message(Address* toaddr, MsgTypes t);
+	char* build_message(MsgTypes t, int since = -1, int limit = 0);
+	int fit_entries(vector<int>& order, int first);
+	char* encode_message(MsgTypes t, vector<int>& order, int first, int count);
+	int piggyback(char* out, int cap);
+	void piggyback_handler(const char* data, int size);
+	char* build_leave(MemberListEntry& leaver);
+	char* build_digest();
+	static unsigned long digest_key(long key);
+	void send_leave(MemberListEntry& leaver, int k);
+	void leave_handler(MessageHdr* msg);
+	void touch_member(MemberListEntry* e);
+	double phi(int id, short port);
+	vector<int> sample_members(int k);
+	vector<int> gossip_targets(int k, bool cross);
+	MemberListEntry* member_entries(MessageHdr* msg);
+	bool decode_message(char* data, int size, MessageHdr* msg);
+	bool decode_swim(char* data, int size, SwimHdr* msg);
+	static int varint_size(unsigned long v);
+	static char* put_varint(char* p, unsigned long v);
+	static const char* get_varint(const char* p, const char* end, unsigned long* v);
+	static unsigned long zigzag(long v);
+	static long unzigzag(unsigned long v);
 
 	void ping_handler(MessageHdr* msg);
+	bool merge_entries(MessageHdr* msg);
+	void health_event(int delta);
+	int health_scale();
 
 	void update_src_member(MessageHdr* msg);
 
 	Address* get_address(int id, short port);
+
+	// SWIM detector
+	void swim_tick();
+	void swim_probe();
+	void swim_send(Address* toaddr, MsgTypes t, Address* target, Address* origin, int seq);
+	void swim_handler(SwimHdr* msg);
+	int swim_priority(char* data, int size);
+	void swim_prioritize();
+	void swim_join_reply(MessageHdr* msg);
+	void swim_apply(SwimUpdate* u);
+	void swim_suspect(MemberListEntry* e);
+	bool swim_confirmed(Suspicion& s, int from);
+	int swim_suspicion(Suspicion& s, int timeout);
+	void swim_confirm(int id, short port, long incarnation);
+	void swim_enqueue(int id, short port, short status, long incarnation, int from = 0);
 };
 
 #endif /* _MP1NODE_H_ */
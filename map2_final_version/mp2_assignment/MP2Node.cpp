@@ -15,6 +15,9 @@ MP2Node::MP2Node(Member *memberNode, Params *par, EmulNet * emulNet, Log * log,
 	this->log = log;
 	ht = new HashTable();
 	this->memberNode->addr = *address;
+	this->ringVersion = -1;
+	this->membershipVersion = 0;
+	this->membership = NULL;
 }
 
 /**
@@ -42,11 +45,16 @@ MP2Node::~MP2Node() {
  * 				   The membership list is returned as a vector of Nodes. See Node class in Node.h
  * 				2) Constructs the ring based on the membership list
  * 				3) Calls the Stabilization Protocol
+ * 				Nothing is done while the membership version MP1 published is the one the ring was built from.
  */
 void MP2Node::updateRing() {
 	/*
 	 * Implement this. Parts of it are already implemented
 	 */
+	if (ringVersion == membershipVersion) {
+		return;
+	}
+	ringVersion = membershipVersion;
 	vector<Node> curMemList;
 	bool change = false;
 
@@ -97,6 +105,15 @@ void MP2Node::updateRing() {
 	//1.成员管理，2.数据复制和一致性，3.环维护，4.其他一致性操作
 }
 
+/**
+ * FUNCTION NAME: membershipChanged
+ *
+ * DESCRIPTION: MP1 listener, notes the new membership version so the next updateRing rebuilds the ring
+ */
+void MP2Node::membershipChanged(void *env, long version) {
+	((MP2Node *)env)->membershipVersion = version;
+}
+
 /**
  * FUNCTION NAME: getMemberhipList
  *
@@ -158,12 +175,9 @@ void MP2Node::clientCreate(string key, string value) {
 	//string data = msg.toString();
 
 	vector<Node> replicas = findNodes(key);
-	for (int i =0; i < replicas.size(); i++) {
+	if (replicas.size() > 0) {
 		Message msg = constructMsg(MessageType::CREATE, key, value);
-		// cout << "client create trans_id :" << msg.transID << " ; address : "<< memberNode->addr.getAddress() << endl;
-		string data = msg.toString();
-		emulNet->ENsend(&memberNode->addr, replicas[i].getAddress(), data);
-		//g_transID ++;
+		multicastMessage(replicas, msg);
 	}
 	g_transID ++;
 	
@@ -187,11 +201,9 @@ void MP2Node::clientRead(string key){
 	//string data = msg.toString();
 
 	vector<Node> replicas = findNodes(key);
-	for (int i =0; i < replicas.size(); i++) {
+	if (replicas.size() > 0) {
 		Message msg = constructMsg(MessageType::READ, key);
-		string data = msg.toString();
-		emulNet->ENsend(&memberNode->addr, replicas[i].getAddress(), data);
-		//g_transID ++;
+		multicastMessage(replicas, msg);
 	}
 	g_transID ++;
 }
@@ -210,11 +222,9 @@ void MP2Node::clientUpdate(string key, string value){
 	//string data = msg.toString();
 
 	vector<Node> replicas = findNodes(key);
-	for (int i =0; i < replicas.size(); i++) {
+	if (replicas.size() > 0) {
 		Message msg = constructMsg(MessageType::UPDATE, key, value);
-		string data = msg.toString();
-		emulNet->ENsend(&memberNode->addr, replicas[i].getAddress(), data);
-		//g_transID ++;
+		multicastMessage(replicas, msg);
 	}
 	g_transID ++;
 	
@@ -234,11 +244,9 @@ void MP2Node::clientDelete(string key){
 	//string data = msg.toString();
 
 	vector<Node> replicas = findNodes(key);
-	for (int i =0; i < replicas.size(); i++) {
+	if (replicas.size() > 0) {
 		Message msg = constructMsg(MessageType::DELETE, key);
-		string data = msg.toString();
-		emulNet->ENsend(&memberNode->addr, replicas[i].getAddress(), data);
-		//g_transID ++;
+		multicastMessage(replicas, msg);
 	}
 	g_transID ++;
 }
@@ -388,18 +396,102 @@ void MP2Node::sendreply(string key, MessageType mType, bool success, Address* fr
 	
 	if(replyType == MessageType::READREPLY){
 		Message msg(transID, this->memberNode->addr, content);
-		string data = msg.toString();
-		emulNet->ENsend(&memberNode->addr, fromaddr, data);	
+		sendMessage(fromaddr, msg);
 	}else{
 		// MessageType::REPLY
 		Message msg(transID, this->memberNode->addr, replyType, success);
-		string data = msg.toString();
-		emulNet->ENsend(&memberNode->addr, fromaddr, data);
+		sendMessage(fromaddr, msg);
 	}	
 }
 
 
 
+/**
+ * FUNCTION NAME: sendMessage
+ *
+ * DESCRIPTION: Serialize the message straight into an EmulNet buffer and send it to toaddr
+ */
+void MP2Node::sendMessage(Address *toaddr, Message &msg) {
+	char *buffer = packMessage(msg);
+	postMessage(toaddr, buffer);
+	emulNet->ENrelease(buffer);
+}
+
+/**
+ * FUNCTION NAME: multicastMessage
+ *
+ * DESCRIPTION: Serialize the message once and send the same buffer to every node in nodes
+ */
+void MP2Node::multicastMessage(vector<Node> &nodes, Message &msg) {
+	vector<Address> toaddrs;
+	for (int i = 0; i < nodes.size(); i++) {
+		toaddrs.push_back(*nodes[i].getAddress());
+	}
+	char *buffer = packMessage(msg);
+	if (outbox.empty() && emulNet->ENcredits(&memberNode->addr) >= (int)toaddrs.size()) {
+		emulNet->ENmulticast(&memberNode->addr, toaddrs, buffer);
+	}
+	else {
+		for (int i = 0; i < (int)toaddrs.size(); i++) {
+			postMessage(&toaddrs[i], buffer);
+		}
+	}
+	emulNet->ENrelease(buffer);
+}
+
+/**
+ * FUNCTION NAME: postMessage
+ *
+ * DESCRIPTION: Send the buffer now if the network has a credit for this node, otherwise queue it
+ * 				behind earlier held messages so that overload delays requests instead of losing them
+ */
+void MP2Node::postMessage(Address *toaddr, char *buffer) {
+	if (outbox.empty() && emulNet->ENcredits(&memberNode->addr) > 0) {
+		emulNet->ENsendBuffer(&memberNode->addr, toaddr, buffer);
+		return;
+	}
+	pendingSend p;
+	p.to = *toaddr;
+	p.buffer = buffer;
+	emulNet->ENretain(buffer);
+	outbox.push_back(p);
+}
+
+/**
+ * FUNCTION NAME: flushOutbox
+ *
+ * DESCRIPTION: Send held messages, oldest first, while credits last
+ */
+void MP2Node::flushOutbox() {
+	while (!outbox.empty() && emulNet->ENcredits(&memberNode->addr) > 0) {
+		pendingSend &p = outbox.front();
+		emulNet->ENsendBuffer(&memberNode->addr, &p.to, p.buffer);
+		emulNet->ENrelease(p.buffer);
+		outbox.pop_front();
+	}
+}
+
+/**
+ * FUNCTION NAME: packMessage
+ *
+ * DESCRIPTION: Serialize the message into a new EmulNet buffer, owned by the caller.
+ * 				With piggybacking the MP1 membership follows the message, then its length in two bytes.
+ */
+char *MP2Node::packMessage(Message &msg) {
+	int size = msg.serialize(NULL, 0);
+	if (membership == NULL) {
+		char *buffer = emulNet->ENalloc(size);
+		msg.serialize(buffer, size);
+		return buffer;
+	}
+	unsigned short extra = membership->piggyback(NULL, 0);
+	char *buffer = emulNet->ENalloc(size + extra + sizeof(unsigned short));
+	msg.serialize(buffer, size);
+	membership->piggyback(buffer + size, extra);
+	memcpy(buffer + size + extra, &extra, sizeof(unsigned short));
+	return buffer;
+}
+
 /**
  * FUNCTION NAME: checkMessages
  *
@@ -419,6 +511,9 @@ void MP2Node::checkMessages() {
 	 * Declare your local variables here
 	 */
 
+	// credits given back by last tick's deliveries let held messages go first
+	flushOutbox();
+
 	// dequeue all messages and handle them
 	//mp2q 是 Member 类中的一个成员变量，用于存储 MP2 协议中接收到的消息队列。
 	//这个变量通常在模拟节点中维护，用于暂时存储从网络中接收到的消息，然后按照一定的顺序逐个处理。
@@ -433,16 +528,25 @@ void MP2Node::checkMessages() {
 		data = (char *)memberNode->mp2q.front().elt;
 		size = memberNode->mp2q.front().size;
 		memberNode->mp2q.pop();
-		//这是C++标准库提供的构造函数形式之一。这个构造函数接受两个迭代器作为参数，用来指定要复制的范围。
-		//在这里，data 是指向字符串的起始位置的指针，data + size 是指向字符串末尾位置的指针。
-		//因此，这个构造函数将从 data 开始的 size 个字符复制到 message 中，从而创建了一个新的字符串对象。
-		string message(data, data + size);
 
 		/*
 		 * Handle the message types here
 		 */
 		//watch message class,has its explanation
-		Message msg(message);
+		// The message is parsed in place, then the network buffer is given back
+		if (membership != NULL && size >= (int)sizeof(unsigned short)) {
+			unsigned short extra;
+			memcpy(&extra, data + size - sizeof(unsigned short), sizeof(unsigned short));
+			// A trailer longer than the message means it is corrupt, so neither part can be trusted
+			if ( (int)extra + (int)sizeof(unsigned short) > size ) {
+				emulNet->ENrelease(data);
+				continue;
+			}
+			size -= sizeof(unsigned short) + extra;
+			membership->piggyback_handler(data + size, extra);
+		}
+		Message msg(data, size);
+		emulNet->ENrelease(data);
 
 
 		switch(msg.type){
@@ -566,7 +670,7 @@ void MP2Node::checkTransMap(){
 		//根据具体情况采取相应的措施，比如记录失败的操作、尝试重新执行操作、或者进行其他错误处理。
 		
 		// time limit 
-		if(this->par->getcurrtime() - it->second->getTime() > 10) {
+		if(this->par->getcurrtime() - it->second->getTime() > this->par->TRANS_TIMEOUT) {
 				logOperation(it->second, true, false, it->first);
 				transComplete.emplace(it->first, false);
 				delete it->second;
@@ -637,27 +741,66 @@ void MP2Node::logOperation(transaction* t, bool isCoordinator, bool success, int
  * 				This function is responsible for finding the replicas of a key
  */
 vector<Node> MP2Node::findNodes(string key) {
+	return findNodes(key, ring);
+}
+
+/**
+ * FUNCTION NAME: findNodes
+ *
+ * DESCRIPTION: Find the replicas the given key has on ring
+ */
+vector<Node> MP2Node::findNodes(string key, vector<Node> &ring) {
 	size_t pos = hashFunction(key);
 	vector<Node> addr_vec;
 	if (ring.size() >= 3) {
 		// if pos <= min || pos > max, the leader is the min
-		if (pos <= ring.at(0).getHashCode() || pos > ring.at(ring.size()-1).getHashCode()) {
-			addr_vec.emplace_back(ring.at(0));
-			addr_vec.emplace_back(ring.at(1));
-			addr_vec.emplace_back(ring.at(2));
-		}
-		else {
+		int leader = 0;
+		if (!(pos <= ring.at(0).getHashCode() || pos > ring.at(ring.size()-1).getHashCode())) {
 			// go through the ring until pos <= node
 			for (int i=1; i<ring.size(); i++){
-				Node addr = ring.at(i);
-				if (pos <= addr.getHashCode()) {
-					addr_vec.emplace_back(addr);
-					addr_vec.emplace_back(ring.at((i+1)%ring.size()));
-					addr_vec.emplace_back(ring.at((i+2)%ring.size()));
+				if (pos <= ring.at(i).getHashCode()) {
+					leader = i;
 					break;
 				}
 			}
 		}
+		if (par->ZONES > 1) {
+			return zoneReplicas(ring, leader);
+		}
+		addr_vec.emplace_back(ring.at(leader));
+		addr_vec.emplace_back(ring.at((leader+1)%ring.size()));
+		addr_vec.emplace_back(ring.at((leader+2)%ring.size()));
+	}
+	return addr_vec;
+}
+
+/**
+ * FUNCTION NAME: zoneReplicas
+ *
+ * DESCRIPTION: The three replicas of the key led by ring[leader], spread over zones.
+ * 				Walking clockwise from the leader, a node is taken if no replica is in its zone yet.
+ * 				With fewer than three zones on the ring the nearest nodes not taken make up the rest.
+ */
+vector<Node> MP2Node::zoneReplicas(vector<Node> &ring, int leader) {
+	int n = ring.size();
+	vector<bool> taken(n, false);
+	vector<int> zones;
+	vector<Node> addr_vec;
+	for (int i = 0; i < n && addr_vec.size() < 3; i++) {
+		int at = (leader + i) % n;
+		int zone = par->getZone(*(int*)ring[at].nodeAddress.addr);
+		if (find(zones.begin(), zones.end(), zone) == zones.end()) {
+			zones.push_back(zone);
+			taken[at] = true;
+			addr_vec.push_back(ring[at]);
+		}
+	}
+	for (int i = 0; i < n && addr_vec.size() < 3; i++) {
+		int at = (leader + i) % n;
+		if (!taken[at]) {
+			taken[at] = true;
+			addr_vec.push_back(ring[at]);
+		}
 	}
 	return addr_vec;
 }
@@ -665,10 +808,12 @@ vector<Node> MP2Node::findNodes(string key) {
 /**
  * FUNCTION NAME: recvLoop
  *
- * DESCRIPTION: Receive messages from EmulNet and push into the queue (mp2q)
+ * DESCRIPTION: Receive messages from EmulNet and push into the queue (mp2q).
+ * 				A failed node drops them instead so that the senders get their credits back.
  */
 bool MP2Node::recvLoop() {
     if ( memberNode->bFailed ) {
+    	emulNet->ENpurge(&(memberNode->addr));
     	return false;
     }
     else {
@@ -700,11 +845,46 @@ void MP2Node::stabilizationProtocol() {
 		string key = it->first;
 		string value = it->second;
 		vector<Node> replicas = findNodes(key);
-		for (int i = 0; i < replicas.size(); i++) {
-			// create
-			Message createMsg(STABLE, this->memberNode->addr, MessageType::CREATE, key, value);
-			string createData = createMsg.toString();
-			emulNet->ENsend(&memberNode->addr, replicas[i].getAddress(), createData);
+		// create
+		Message createMsg(STABLE, this->memberNode->addr, MessageType::CREATE, key, value);
+		multicastMessage(replicas, createMsg);
+	}
+}
+
+/**
+ * FUNCTION NAME: handoff
+ *
+ * DESCRIPTION: Runs when this node leaves the ring on purpose, before it goes.
+ * 				Every key it holds is sent to the node that becomes a replica of the key once this
+ * 				node is gone, so the key is back to three copies without waiting for the others
+ * 				to notice the leave. Messages still held for credits when the node goes are lost,
+ * 				and the stabilization protocol of the remaining replicas covers them.
+ */
+void MP2Node::handoff() {
+	vector<Node> remaining;
+	for (int i = 0; i < (int)ring.size(); i++) {
+		if (!(ring[i].nodeAddress == memberNode->addr)) {
+			remaining.push_back(ring[i]);
+		}
+	}
+	map<string, string>::iterator it;
+	for (it = this->ht->hashTable.begin(); it != this->ht->hashTable.end(); it++) {
+		vector<Node> replicas = findNodes(it->first);
+		vector<Node> successors = findNodes(it->first, remaining);
+		vector<Node> handTo;
+		for (int i = 0; i < (int)successors.size(); i++) {
+			bool holds = false;
+			for (int j = 0; j < (int)replicas.size() && !holds; j++) {
+				holds = successors[i].nodeAddress == replicas[j].nodeAddress;
+			}
+			if (!holds) {
+				handTo.push_back(successors[i]);
+			}
+		}
+		if (!handTo.empty()) {
+			Message createMsg(STABLE, this->memberNode->addr, MessageType::CREATE, it->first, it->second);
+			multicastMessage(handTo, createMsg);
 		}
 	}
+	ring = remaining;
 }
@@ -18,6 +18,7 @@
 #include "Params.h"
 #include "Message.h"
 #include "Queue.h"
+#include "MP1Node.h"
 const int STABLE = -1;
 
 class transaction {
@@ -34,6 +35,16 @@ public:
 	int getTime(){ return timestamp;};
 };
 
+/**
+ * STRUCT NAME: pendingSend
+ *
+ * DESCRIPTION: A message held back while EmulNet has no credits left for this node
+ */
+typedef struct pendingSend {
+	Address to;
+	char *buffer;
+}pendingSend;
+
 /**
  * CLASS NAME: MP2Node
  *
@@ -66,6 +77,13 @@ private:
 	map<int, transaction*> transMap;
 	// <trans_id, success> 
 	map<int, bool> transComplete; 
+	// Messages waiting for credits, sent in order by flushOutbox
+	deque<pendingSend> outbox;
+	// Membership version the ring was built from, and the latest one MP1 published
+	long ringVersion;
+	long membershipVersion;
+	// Membership protocol whose state rides on every KV message, NULL when PIGGYBACK is off
+	MP1Node *membership;
 
 public:
 	MP2Node(Member *memberNode, Params *par, EmulNet *emulNet, Log *log, Address *addressOfMember);
@@ -75,6 +93,10 @@ public:
 
 	// ring functionalities
 	void updateRing();
+	static void membershipChanged(void *env, long version);
+	void setMembership(MP1Node *mp1) {
+		this->membership = mp1;
+	}
 	vector<Node> getMembershipList();
 	size_t hashFunction(string key);
 	void findNeighbors();
@@ -97,6 +119,8 @@ public:
 
 	// find the addresses of nodes that are responsible for a key
 	vector<Node> findNodes(string key);
+	vector<Node> findNodes(string key, vector<Node> &ring);
+	vector<Node> zoneReplicas(vector<Node> &ring, int leader);
 
 	// server
 	bool createKeyValue(string key, string value, ReplicaType replica, int transID);
@@ -106,11 +130,18 @@ public:
 
 	// stabilization protocol - handle multiple failures
 	void stabilizationProtocol();
+	// hand the keys over before leaving on purpose
+	void handoff();
 	
 	// My function 
 	Message constructMsg(MessageType mType, string key, string value = "", bool success = false);
 	void createTransaction(int trans_id, MessageType mType, string key, string value);
 	void sendreply(string key, MessageType mType, bool success, Address* fromaddr, int transID, string content = "");
+	void sendMessage(Address *toaddr, Message &msg);
+	void multicastMessage(vector<Node> &nodes, Message &msg);
+	char *packMessage(Message &msg);
+	void postMessage(Address *toaddr, char *buffer);
+	void flushOutbox();
 	void checkTransMap();
 	void logOperation(transaction* t, bool isCoordinator, bool success, int transID);
 
@@ -15,42 +15,94 @@
 // transID::fromAddr::REPLY::sucess
 // transID::fromAddr::READREPLY::value
 Message::Message(string message){
+	parse(message.data(), (int)message.size());
+}
+
+/**
+ * Constructor
+ */
+Message::Message(const char *data, int size){
+	parse(data, size);
+}
+
+/**
+ * FUNCTION NAME: parseInt
+ *
+ * DESCRIPTION: Parse a decimal field that is not NUL terminated
+ */
+static int parseInt(const char *p, int len) {
+	int sign = 1;
+	int val = 0;
+	int i = 0;
+	if ( len > 0 && p[0] == '-' ) {
+		sign = -1;
+		i++;
+	}
+	for ( ; i < len; i++ ) {
+		val = val * 10 + (p[i] - '0');
+	}
+	return sign * val;
+}
+
+/**
+ * FUNCTION NAME: parse
+ *
+ * DESCRIPTION: Split the "::" separated fields of a serialized message without copying the buffer
+ */
+void Message::parse(const char *data, int size){
 	this->delimiter = "::";
-	vector<string> tuple;
-	size_t pos = message.find(delimiter);
-	size_t start = 0;
-	while (pos != string::npos) {
-		string field = message.substr(start, pos-start);
-		tuple.push_back(field);
-		start = pos + 2;
-		pos = message.find(delimiter, start);
+	// (start, length) of every field
+	const char *field[6];
+	int len[6];
+	int nfields = 0;
+	const char *start = data;
+	const char *end = data + size;
+	const char *p = data;
+	while ( nfields < 5 && p + 1 < end ) {
+		if ( p[0] == ':' && p[1] == ':' ) {
+			field[nfields] = start;
+			len[nfields] = p - start;
+			nfields++;
+			p += 2;
+			start = p;
+		}
+		else {
+			p++;
+		}
 	}
-	tuple.push_back(message.substr(start));
+	field[nfields] = start;
+	len[nfields] = end - start;
+	nfields++;
+	assert(nfields >= 4);
 
-	transID = stoi(tuple.at(0));
-	Address addr(tuple.at(1));
-	fromAddr = addr;
-	type = static_cast<MessageType>(stoi(tuple.at(2)));
+	transID = parseInt(field[0], len[0]);
+	// fromAddr is "id:port"
+	const char *colon = (const char *)memchr(field[1], ':', len[1]);
+	int id = parseInt(field[1], colon - field[1]);
+	short port = (short)parseInt(colon + 1, field[1] + len[1] - colon - 1);
+	memcpy(&fromAddr.addr[0], &id, sizeof(int));
+	memcpy(&fromAddr.addr[4], &port, sizeof(short));
+	type = static_cast<MessageType>(parseInt(field[2], len[2]));
 	switch(type){
 		case CREATE:
 		case UPDATE:
-			key = tuple.at(3);
-			value = tuple.at(4);
-			if (tuple.size() > 5)
-				replica = static_cast<ReplicaType>(stoi(tuple.at(5)));
+			key.assign(field[3], len[3]);
+			value.assign(field[4], len[4]);
+			if (nfields > 5)
+				replica = static_cast<ReplicaType>(parseInt(field[5], len[5]));
 			break;
 		case READ:
 		case DELETE:
-			key = tuple.at(3);
+			key.assign(field[3], len[3]);
 			break;
 		case REPLY:
-			if (tuple.at(3) == "1")
+			if (len[3] == 1 && field[3][0] == '1')
 				success = true;
 			else
 				success = false;
 			break;
 		case READREPLY:
-			value = tuple.at(3);
+			value.assign(field[3], len[3]);
 			break;
 	}
 }
@@ -137,27 +189,61 @@ Message::Message(int _transID, Address _fromAddr, string _value){
  * DESCRIPTION: Serialized Message in string format
  */
 string Message::toString(){
-	string message = to_string(transID) + delimiter + fromAddr.getAddress() + delimiter + to_string(type) + delimiter;
+	string message(serialize(NULL, 0), '\0');
+	serialize(&message[0], message.size());
+	return message;
+}
+
+/**
+ * FUNCTION NAME: appendField
+ *
+ * DESCRIPTION: Append len bytes to out if they fit, returns the new length
+ */
+static int appendField(char *out, int cap, int pos, const char *src, int len) {
+	if ( pos + len <= cap ) {
+		memcpy(out + pos, src, len);
+	}
+	return pos + len;
+}
+
+/**
+ * FUNCTION NAME: serialize
+ *
+ * DESCRIPTION: Serialize the message straight into a network buffer, in the same format as toString.
+ * 				Call with cap = 0 to get the length to allocate.
+ */
+int Message::serialize(char *out, int cap){
+	char num[64];
+	int id = 0;
+	short port = 0;
+	int n;
+	int pos;
+	memcpy(&id, &fromAddr.addr[0], sizeof(int));
+	memcpy(&port, &fromAddr.addr[4], sizeof(short));
+
+	n = sprintf(num, "%d::%d:%d::%d::", transID, id, port, type);
+	pos = appendField(out, cap, 0, num, n);
 	switch(type){
 		case CREATE:
 		case UPDATE:
-			message += key + delimiter + value + delimiter + to_string(replica);
+			pos = appendField(out, cap, pos, key.data(), key.size());
+			pos = appendField(out, cap, pos, "::", 2);
+			pos = appendField(out, cap, pos, value.data(), value.size());
+			n = sprintf(num, "::%d", replica);
+			pos = appendField(out, cap, pos, num, n);
 			break;
 		case READ:
 		case DELETE:
-			message += key;
+			pos = appendField(out, cap, pos, key.data(), key.size());
 			break;
 		case REPLY:
-			if (success)
-				message += "1";
-			else
-				message += "0";
+			pos = appendField(out, cap, pos, success ? "1" : "0", 1);
 			break;
 		case READREPLY:
-			message += value;
+			pos = appendField(out, cap, pos, value.data(), value.size());
 			break;
 	}
-	return message;
+	return pos;
 }
 
 /**
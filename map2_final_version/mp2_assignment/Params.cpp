@@ -18,9 +18,57 @@ Params::Params(): PORTNUM(8001) {}
  */
 void Params::setparams(char *config_file) {
 	//trace.funcEntry("Params::setparams");
-	char CRUD[10];
+	char CRUD[10] = "";
+	char key[64];
 	FILE *fp = fopen(config_file,"r");
 
+	// Membership only run unless the config names a CRUD test
+	this->CRUDTEST = MEMBERSHIP_TEST;
+	SINGLE_FAILURE = 0;
+	DROP_MSG = 0;
+	MSG_DROP_PROB = 0;
+
+	// Defaults of the optional settings
+	LINK_DELAY = 0;
+	LINK_JITTER = 0;
+	BANDWIDTH = 0;
+	TRANS_TIMEOUT = 10;
+	T_FAIL = 5;
+	T_REMOVE = 20;
+	GOSSIP_FANOUT = 0;
+	GOSSIP_INTERVAL = 1;
+	GOSSIP_ENTRIES = 0;
+	GOSSIP_DELTA = 0;
+	GOSSIP_SYNC = 20;
+	TOMBSTONE = 0;
+	FAIL_TIME = 100;
+	LEAVE = 0;
+	INTRODUCERS = 1;
+	ZONES = 1;
+	ZONE_CROSS = 4;
+	PIGGYBACK = 0;
+	WRITE_LOAD = 0;
+	DETECTOR = HEARTBEAT_DETECTOR;
+	PHI_THRESHOLD = 8;
+	LOCAL_HEALTH = 0;
+	SWIM_PERIOD = 6;
+	SWIM_TIMEOUT = 2;
+	SWIM_PROBES = 3;
+	SWIM_PIGGYBACK = 8;
+	EN_CREDITS = 1000;
+	EN_BUFF_MAX = 240000;
+	TRANSPORT = EMUL_TRANSPORT;
+	UDP_PORT = 20000;
+	UDP_BATCH = 64;
+	SHM_RING = 8192;
+	SHM_NAME[0] = '\0';
+	SHM_PROCS = 1;
+	SHM_PROC = 0;
+	SEED = (unsigned int)time(NULL);
+	links.clear();
+	zoneOf.clear();
+	overloads.clear();
+
 	fscanf(fp,"MAX_NNB: %d", &MAX_NNB);
 	fscanf(fp,"\nSINGLE_FAILURE: %d", &SINGLE_FAILURE);
 	fscanf(fp,"\nDROP_MSG: %d", &DROP_MSG);
@@ -40,6 +88,15 @@ void Params::setparams(char *config_file) {
 		this->CRUDTEST = DELETE_TEST;
 	}
 
+	// Optional "KEY: value" lines may follow in any order
+	while ( fscanf(fp, " %63[^:]:", key) == 1 ) {
+		setoption(key, fp);
+	}
+	// ZONE lines alone turn zones on, with as many zones as they name
+	for ( unsigned int i = 0; i < zoneOf.size(); i++ ) {
+		ZONES = max(ZONES, zoneOf[i] + 1);
+	}
+
 	//printf("Parameters of the test case: %d %d %d %lf\n", MAX_NNB, SINGLE_FAILURE, DROP_MSG, MSG_DROP_PROB);
 
 	EN_GPSZ = MAX_NNB;
@@ -56,6 +113,236 @@ void Params::setparams(char *config_file) {
 	return;
 }
 
+/**
+ * FUNCTION NAME: setoption
+ *
+ * DESCRIPTION: Read the value of one optional setting from the config file
+ * 				LINK takes four values: from to delay jitter
+ * 				ZONE takes three values: first id, last id and the zone they are in
+ * 				OVERLOAD takes five values: first id, last id, from tick, to tick and the message budget
+ * 				TRANSPORT takes a name, EMUL, UDP or SHM, and SHM_NAME a segment name
+ * 				DETECTOR takes a name, HEARTBEAT, SWIM or PHI
+ */
+void Params::setoption(char *key, FILE *fp) {
+	if ( 0 == strcmp(key, "LINK") ) {
+		int from, to;
+		LinkModel link;
+		if ( fscanf(fp, "%d %d %d %d", &from, &to, &link.delay, &link.jitter) == 4 ) {
+			links[make_pair(from, to)] = link;
+		}
+		return;
+	}
+	if ( 0 == strcmp(key, "ZONE") ) {
+		int first, last, zone;
+		if ( fscanf(fp, "%d %d %d", &first, &last, &zone) == 3 && first > 0 && first <= last && zone >= 0 ) {
+			if ( last >= (int)zoneOf.size() ) {
+				zoneOf.resize(last + 1, -1);
+			}
+			for ( int id = first; id <= last; id++ ) {
+				zoneOf[id] = zone;
+			}
+		}
+		return;
+	}
+	if ( 0 == strcmp(key, "OVERLOAD") ) {
+		Overload spike;
+		if ( fscanf(fp, "%d %d %d %d %d", &spike.first, &spike.last, &spike.from, &spike.to, &spike.budget) == 5 && spike.budget > 0 ) {
+			overloads.push_back(spike);
+		}
+		return;
+	}
+	if ( 0 == strcmp(key, "TRANSPORT") ) {
+		char name[16] = "";
+		fscanf(fp, "%15s", name);
+		if ( 0 == strcmp(name, "UDP") ) {
+			TRANSPORT = UDP_TRANSPORT;
+		}
+		else if ( 0 == strcmp(name, "SHM") ) {
+			TRANSPORT = SHM_TRANSPORT;
+		}
+		else {
+			TRANSPORT = EMUL_TRANSPORT;
+		}
+		return;
+	}
+	if ( 0 == strcmp(key, "SHM_NAME") ) {
+		fscanf(fp, "%63s", SHM_NAME);
+		return;
+	}
+	if ( 0 == strcmp(key, "DETECTOR") ) {
+		char name[16] = "";
+		fscanf(fp, "%15s", name);
+		if ( 0 == strcmp(name, "SWIM") ) {
+			DETECTOR = SWIM_DETECTOR;
+		}
+		else if ( 0 == strcmp(name, "PHI") ) {
+			DETECTOR = PHI_DETECTOR;
+		}
+		else {
+			DETECTOR = HEARTBEAT_DETECTOR;
+		}
+		return;
+	}
+
+	int value = 0;
+	if ( fscanf(fp, "%d", &value) != 1 ) {
+		// Unknown format, skip the rest of the line
+		fscanf(fp, "%*[^\n]");
+		return;
+	}
+	if ( 0 == strcmp(key, "LINK_DELAY") ) {
+		LINK_DELAY = value;
+	}
+	else if ( 0 == strcmp(key, "LINK_JITTER") ) {
+		LINK_JITTER = value;
+	}
+	else if ( 0 == strcmp(key, "BANDWIDTH") ) {
+		BANDWIDTH = value;
+	}
+	else if ( 0 == strcmp(key, "TRANS_TIMEOUT") ) {
+		TRANS_TIMEOUT = value;
+	}
+	else if ( 0 == strcmp(key, "TFAIL") ) {
+		T_FAIL = value;
+	}
+	else if ( 0 == strcmp(key, "TREMOVE") ) {
+		T_REMOVE = value;
+	}
+	else if ( 0 == strcmp(key, "GOSSIP_FANOUT") ) {
+		GOSSIP_FANOUT = value;
+	}
+	else if ( 0 == strcmp(key, "GOSSIP_INTERVAL") && value > 0 ) {
+		GOSSIP_INTERVAL = value;
+	}
+	else if ( 0 == strcmp(key, "GOSSIP_ENTRIES") ) {
+		GOSSIP_ENTRIES = value;
+	}
+	else if ( 0 == strcmp(key, "GOSSIP_DELTA") ) {
+		GOSSIP_DELTA = value;
+	}
+	else if ( 0 == strcmp(key, "GOSSIP_SYNC") && value > 0 ) {
+		GOSSIP_SYNC = value;
+	}
+	else if ( 0 == strcmp(key, "TOMBSTONE") ) {
+		TOMBSTONE = value;
+	}
+	else if ( 0 == strcmp(key, "FAIL_TIME") ) {
+		FAIL_TIME = value;
+	}
+	else if ( 0 == strcmp(key, "LEAVE") ) {
+		LEAVE = value;
+	}
+	else if ( 0 == strcmp(key, "ZONES") && value > 0 ) {
+		ZONES = value;
+	}
+	else if ( 0 == strcmp(key, "ZONE_CROSS") && value > 0 ) {
+		ZONE_CROSS = value;
+	}
+	else if ( 0 == strcmp(key, "PIGGYBACK") ) {
+		PIGGYBACK = value;
+	}
+	else if ( 0 == strcmp(key, "WRITE_LOAD") ) {
+		WRITE_LOAD = value;
+	}
+	else if ( 0 == strcmp(key, "INTRODUCERS") ) {
+		if ( value > 0 ) {
+			INTRODUCERS = value;
+		}
+	}
+	else if ( 0 == strcmp(key, "LOCAL_HEALTH") ) {
+		LOCAL_HEALTH = value;
+	}
+	else if ( 0 == strcmp(key, "PHI_THRESHOLD") && value > 0 ) {
+		PHI_THRESHOLD = value;
+	}
+	else if ( 0 == strcmp(key, "SWIM_PERIOD") && value > 0 ) {
+		SWIM_PERIOD = value;
+	}
+	else if ( 0 == strcmp(key, "SWIM_TIMEOUT") && value > 0 ) {
+		SWIM_TIMEOUT = value;
+	}
+	else if ( 0 == strcmp(key, "SWIM_PROBES") ) {
+		SWIM_PROBES = value;
+	}
+	else if ( 0 == strcmp(key, "SWIM_PIGGYBACK") ) {
+		SWIM_PIGGYBACK = value;
+	}
+	else if ( 0 == strcmp(key, "EN_CREDITS") ) {
+		EN_CREDITS = value;
+	}
+	else if ( 0 == strcmp(key, "EN_BUFF_MAX") ) {
+		EN_BUFF_MAX = value;
+	}
+	else if ( 0 == strcmp(key, "UDP_PORT") ) {
+		UDP_PORT = value;
+	}
+	else if ( 0 == strcmp(key, "UDP_BATCH") && value > 0 ) {
+		UDP_BATCH = value;
+	}
+	else if ( 0 == strcmp(key, "SHM_RING") && value > 0 ) {
+		// Round up to a power of two so positions map to offsets with a mask
+		SHM_RING = 1;
+		while ( SHM_RING < value ) {
+			SHM_RING <<= 1;
+		}
+	}
+	else if ( 0 == strcmp(key, "SHM_PROCS") && value > 0 ) {
+		SHM_PROCS = value;
+	}
+	else if ( 0 == strcmp(key, "SHM_PROC") && value >= 0 ) {
+		SHM_PROC = value;
+	}
+}
+
+/**
+ * FUNCTION NAME: getLinkModel
+ *
+ * DESCRIPTION: Delay model of the link from -> to. The most specific LINK entry wins,
+ * 				otherwise LINK_DELAY and LINK_JITTER apply.
+ */
+LinkModel Params::getLinkModel(int from, int to) {
+	LinkModel link;
+	map<pair<int, int>, LinkModel>::iterator it;
+	if ( !links.empty() ) {
+		if ( (it = links.find(make_pair(from, to))) != links.end() ||
+			 (it = links.find(make_pair(from, 0))) != links.end() ||
+			 (it = links.find(make_pair(0, to))) != links.end() ) {
+			return it->second;
+		}
+	}
+	link.delay = LINK_DELAY;
+	link.jitter = LINK_JITTER;
+	return link;
+}
+
+/**
+ * FUNCTION NAME: getZone
+ *
+ * DESCRIPTION: Zone of node id. A ZONE line wins, otherwise ids go round robin over ZONES zones.
+ * 				Every node computes the same labels from the config, so they are never sent.
+ */
+int Params::getZone(int id) {
+	if ( id >= 0 && id < (int)zoneOf.size() && zoneOf[id] >= 0 ) {
+		return zoneOf[id];
+	}
+	return ZONES > 1 && id > 0 ? (id - 1) % ZONES : 0;
+}
+
+/**
+ * FUNCTION NAME: getBudget
+ *
+ * DESCRIPTION: MP1 messages node id may handle this tick, 0 when it is not overloaded
+ */
+int Params::getBudget(int id) {
+	for ( unsigned int i = 0; i < overloads.size(); i++ ) {
+		Overload &spike = overloads[i];
+		if ( id >= spike.first && id <= spike.last && globaltime >= spike.from && globaltime < spike.to ) {
+			return spike.budget;
+		}
+	}
+	return 0;
+}
+
 /**
  * FUNCTION NAME: getcurrtime
  *
@@ -65,3 +352,29 @@ void Params::setparams(char *config_file) {
 int Params::getcurrtime(){
     return globaltime;
 }
+
+/**
+ * FUNCTION NAME: isLocal
+ *
+ * DESCRIPTION: Whether this process runs node id. A multi-process SHM run splits ids 1..EN_GPSZ
+ * 				into SHM_PROCS contiguous ranges, process k runs the k-th; otherwise every node is local.
+ */
+bool Params::isLocal(int id) {
+	if ( TRANSPORT != SHM_TRANSPORT || SHM_PROCS <= 1 ) {
+		return true;
+	}
+	return id > SHM_PROC * EN_GPSZ / SHM_PROCS && id <= (SHM_PROC + 1) * EN_GPSZ / SHM_PROCS;
+}
+
+/**
+ * FUNCTION NAME: localNodes
+ *
+ * DESCRIPTION: Number of nodes this process runs
+ */
+int Params::localNodes() {
+	int count = 0;
+	for ( int id = 1; id <= EN_GPSZ; id++ ) {
+		count += isLocal(id);
+	}
+	return count;
+}
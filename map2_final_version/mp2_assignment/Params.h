@@ -11,7 +11,34 @@
 #include "Params.h"
 #include "Member.h"
 
-enum testTYPE { CREATE_TEST, READ_TEST, UPDATE_TEST, DELETE_TEST };
+enum testTYPE { MEMBERSHIP_TEST = -1, CREATE_TEST, READ_TEST, UPDATE_TEST, DELETE_TEST };
+enum transportTYPE { EMUL_TRANSPORT, UDP_TRANSPORT, SHM_TRANSPORT };
+enum detectorTYPE { HEARTBEAT_DETECTOR, SWIM_DETECTOR, PHI_DETECTOR };
+
+/**
+ * STRUCT NAME: LinkModel
+ *
+ * DESCRIPTION: Delay of one link in ticks. Every message waits delay ticks plus a
+ * 				uniformly drawn 0..jitter ticks.
+ */
+typedef struct LinkModel {
+	int delay;
+	int jitter;
+}LinkModel;
+
+/**
+ * STRUCT NAME: Overload
+ *
+ * DESCRIPTION: Load spike of a benchmark: nodes first to last handle at most budget MP1 messages
+ * 				per tick from tick from until tick to, the rest wait in their queue.
+ */
+typedef struct Overload {
+	int first;
+	int last;
+	int from;
+	int to;
+	int budget;
+}Overload;
 
 /**
  * CLASS NAME: Params
@@ -31,9 +58,54 @@ public:
 	int globaltime;
 	int allNodesJoined;
 	short PORTNUM;
-	int CRUDTEST;
+	int CRUDTEST;				// MEMBERSHIP_TEST when the config has no CRUD_TEST
+	int LINK_DELAY;				// default one-way delay in ticks
+	int LINK_JITTER;			// default extra random delay in ticks
+	int BANDWIDTH;				// per node outgoing bytes per tick, 0 means unlimited
+	int TRANS_TIMEOUT;			// ticks a coordinator waits for a quorum
+	int T_FAIL;					// MP1 ping counter
+	int T_REMOVE;				// ticks without a heartbeat before MP1 removes a member
+	int GOSSIP_FANOUT;			// members MP1 pings per round, 0 means every member
+	int GOSSIP_INTERVAL;		// ticks between MP1 gossip rounds
+	int GOSSIP_ENTRIES;			// member list entries carried per MP1 message, 0 means all
+	int GOSSIP_DELTA;			// ticks between republishing a member's heartbeat to peers, 0 sends whole lists
+	int GOSSIP_SYNC;			// ticks between full push-pull syncs with one random member in delta mode
+	int TOMBSTONE;				// ticks a removed member is kept from coming back by older gossip, 0 means 2 * T_REMOVE
+	int FAIL_TIME;				// tick at which a membership only run fails nodes
+	int LEAVE;					// 1 makes the nodes a run takes down leave gracefully instead of crashing
+	int INTRODUCERS;			// Nodes 1 to INTRODUCERS answer JOINREQs, each joiner picks one at random
+	int ZONES;					// number of zones (racks), nodes are placed round robin by id; 1 turns zones off
+	int ZONE_CROSS;				// MP1 gossips to another zone once every ZONE_CROSS rounds, otherwise within its own
+	int PIGGYBACK;				// MP2 messages carry MP1 membership; peers heard from that way skip MP1 gossip for PIGGYBACK ticks, 0 is off
+	int WRITE_LOAD;				// updates of random test keys issued per tick after the inserts, a write heavy load for benchmarks
+	int DETECTOR;				// MP1 failure detector, HEARTBEAT (all to all or gossip), SWIM or PHI
+	int PHI_THRESHOLD;			// suspicion level at which the PHI detector removes a member
+	int LOCAL_HEALTH;			// highest local health score, a node that falls behind stretches its timeouts up to LOCAL_HEALTH + 1 times; 0 is off
+	int SWIM_PERIOD;			// ticks per SWIM protocol period, one direct probe each
+	int SWIM_TIMEOUT;			// ticks SWIM waits for a direct ACK before probing indirectly
+	int SWIM_PROBES;			// members asked to probe indirectly with a PINGREQ
+	int SWIM_PIGGYBACK;			// membership updates piggybacked per SWIM message
+	int EN_CREDITS;				// messages one node may have in flight before EmulNet refuses more
+	int EN_BUFF_MAX;			// hard bound on in-flight messages in EmulNet
+	int TRANSPORT;				// EMUL (in-memory mailboxes), UDP (loopback sockets) or SHM (shared memory rings)
+	int UDP_PORT;				// first loopback port of the UDP transport
+	int UDP_BATCH;				// datagrams per sendmmsg/recvmmsg call of the UDP transport
+	int SHM_RING;				// bytes of the ring from one node to another in the SHM transport, a power of two
+	char SHM_NAME[64];			// shared memory segment the processes of a run meet on, private to the run if empty
+	int SHM_PROCS;				// processes sharing the SHM segment, each runs its own range of node ids
+	int SHM_PROC;				// which of the SHM_PROCS processes this one is, from 0
+	unsigned int SEED;			// seed of the failures a run injects, the same in every process of the run
+	map<pair<int, int>, LinkModel> links;	// per link overrides, (from, to), 0 matches any node
+	vector<Overload> overloads;	// load spikes, see Overload
+	vector<int> zoneOf;			// zone of each node id placed by a ZONE line, -1 for round robin
 	Params();
 	void setparams(char *);
+	void setoption(char *key, FILE *fp);
+	LinkModel getLinkModel(int from, int to);
+	int getZone(int id);
+	int getBudget(int id);
+	bool isLocal(int id);
+	int localNodes();
 	int getcurrtime();
 };
 
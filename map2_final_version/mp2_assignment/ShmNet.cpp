@@ -0,0 +1,378 @@
+/**********************************
+ * FILE NAME: ShmNet.cpp
+ *
+ * DESCRIPTION: Definition of the shared memory ring transport
+ **********************************/
+
+#include "ShmNet.h"
+
+/**
+ * Constructor
+ *
+ * Creates the segment, or attaches to it when another process of the run already has.
+ * The owner lays it out and publishes the magic last; an attaching process waits for the magic
+ * and refuses a segment laid out for another config.
+ * A private segment is unlinked as soon as it is opened, a named one once every process has it mapped,
+ * so nothing is left behind in /dev/shm.
+ */
+ShmNet::ShmNet(Params *p, int instance): EmulNet(p, instance) {
+	char segment[96];
+	int nodes = par->EN_GPSZ;
+	int procs = par->SHM_PROCS;
+	int proc = par->SHM_PROC;
+	bool named = par->SHM_NAME[0] != '\0';
+
+	if ( procs > SHM_MAX_PROCS || proc >= procs || procs > nodes ) {
+		fprintf(stderr, "ShmNet: cannot run process %d of %d with %d nodes\n", proc, procs, nodes);
+		exit(1);
+	}
+	if ( procs > 1 && (!named || par->CRUDTEST != MEMBERSHIP_TEST) ) {
+		fprintf(stderr, "ShmNet: a run of %d processes needs SHM_NAME and runs membership only\n", procs);
+		exit(1);
+	}
+
+	if ( named ) {
+		sprintf(segment, "/%s_%d", par->SHM_NAME, instance);
+	}
+	else {
+		sprintf(segment, "/emulnet_%d_%d", (int)getpid(), instance);
+	}
+	name = segment;
+
+	// A ring must hold the largest message with its record header, rounded like a record
+	int ringSize = par->SHM_RING;
+	while ( ringSize < (int)(sizeof(shm_record) + par->MAX_MSG_SIZE + 7) ) {
+		ringSize <<= 1;
+	}
+	mask = ringSize - 1;
+	ringOffset = (sizeof(shm_header) + SHM_LINE - 1) / SHM_LINE * SHM_LINE;
+	dataOffset = ringOffset + (size_t)nodes * nodes * sizeof(shm_ring);
+	length = dataOffset + (size_t)nodes * nodes * ringSize;
+
+	int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+	bool owner = ( fd >= 0 );
+	if ( owner && !named ) {
+		shm_unlink(name.c_str());
+	}
+	if ( owner && ftruncate(fd, length) < 0 ) {
+		close(fd);
+		fd = -1;
+	}
+	if ( !owner && named && errno == EEXIST ) {
+		fd = shm_open(name.c_str(), O_RDWR, 0);
+	}
+	if ( fd < 0 ) {
+		fprintf(stderr, "ShmNet: cannot open segment %s: %s\n", name.c_str(), strerror(errno));
+		exit(1);
+	}
+
+	// The owner may not have sized the segment yet
+	struct stat st;
+	st.st_size = 0;
+	time_t deadline = time(NULL) + SHM_WAIT;
+	while ( fstat(fd, &st) == 0 && st.st_size == 0 && time(NULL) < deadline ) {
+		usleep(1000);
+	}
+	if ( st.st_size != (off_t)length ) {
+		fprintf(stderr, "ShmNet: segment %s is %ld bytes, this config lays out %ld\n", name.c_str(), (long)st.st_size, (long)length);
+		exit(1);
+	}
+
+	base = (char *)mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if ( base == MAP_FAILED ) {
+		fprintf(stderr, "ShmNet: cannot map segment %s: %s\n", name.c_str(), strerror(errno));
+		exit(1);
+	}
+	header = (shm_header *)base;
+
+	if ( owner ) {
+		// ftruncate zero filled the rings, which makes them empty
+		header->nodes = nodes;
+		header->procs = procs;
+		header->ringSize = ringSize;
+		header->msgSize = par->MAX_MSG_SIZE;
+		header->seed = par->SEED;
+		header->magic.store(SHM_MAGIC, memory_order_release);
+	}
+	else {
+		while ( header->magic.load(memory_order_acquire) != SHM_MAGIC && time(NULL) < deadline ) {
+			usleep(1000);
+		}
+		if ( header->magic.load(memory_order_acquire) != SHM_MAGIC ) {
+			fprintf(stderr, "ShmNet: segment %s was never laid out\n", name.c_str());
+			exit(1);
+		}
+		if ( header->nodes != nodes || header->procs != procs || header->ringSize != ringSize || header->msgSize != par->MAX_MSG_SIZE ) {
+			fprintf(stderr, "ShmNet: segment %s holds %d nodes over %d processes with %d byte rings, this config wants %d over %d with %d\n",
+					name.c_str(), header->nodes, header->procs, header->ringSize, nodes, procs, ringSize);
+			exit(1);
+		}
+		// Fail the same nodes as the owner
+		par->SEED = header->seed;
+	}
+
+	int expected = 0;
+	if ( !header->claimed[proc].compare_exchange_strong(expected, 1) ) {
+		fprintf(stderr, "ShmNet: process %d already runs on segment %s; remove /dev/shm%s if it is left from a dead run\n",
+				proc, name.c_str(), name.c_str());
+		exit(1);
+	}
+	if ( named && header->attached.fetch_add(1) + 1 == procs ) {
+		shm_unlink(name.c_str());
+	}
+
+	pushed = 0;
+	popped = 0;
+}
+
+/**
+ * Destructor
+ */
+ShmNet::~ShmNet() {
+	munmap(base, length);
+}
+
+/**
+ * FUNCTION NAME: ringIndex
+ *
+ * DESCRIPTION: Index of the ring from node id src to node id dst. The rings into one node are
+ * 				next to each other, so its consumer reads a single run of heads.
+ */
+int ShmNet::ringIndex(int src, int dst) {
+	return (dst - 1) * header->nodes + (src - 1);
+}
+
+/**
+ * FUNCTION NAME: ring
+ *
+ * DESCRIPTION: Head and tail of the ring from src to dst
+ */
+shm_ring *ShmNet::ring(int src, int dst) {
+	return (shm_ring *)(base + ringOffset) + ringIndex(src, dst);
+}
+
+/**
+ * FUNCTION NAME: data
+ *
+ * DESCRIPTION: Bytes of the ring from src to dst
+ */
+char *ShmNet::data(int src, int dst) {
+	return base + dataOffset + (size_t)ringIndex(src, dst) * header->ringSize;
+}
+
+/**
+ * FUNCTION NAME: ENinit
+ *
+ * DESCRIPTION: Give the node its id; its rings already exist in the segment.
+ * 				Every process hands out the same ids in the same order, and runs only its own.
+ */
+void *ShmNet::ENinit(Address *myaddr, short port) {
+	EmulNet::ENinit(myaddr, port);
+	int id = *(int *)(myaddr->addr);
+	if ( id < 1 || id > header->nodes ) {
+		fprintf(stderr, "ShmNet: node %d does not fit in segment %s of %d nodes\n", id, name.c_str(), header->nodes);
+		exit(1);
+	}
+	return myaddr;
+}
+
+/**
+ * FUNCTION NAME: ENsendBuffer
+ *
+ * DESCRIPTION: Append the payload to the ring from the sender to the destination.
+ * 				The sender is the ring's only producer, so this is a copy and a release store of head.
+ *
+ * RETURNS:
+ * size
+ */
+int ShmNet::ENsendBuffer(Address *myaddr, Address *toaddr, char *buffer) {
+	en_buf *buf = (en_buf *)buffer - 1;
+	int size = buf->size;
+	int src = *(int *)(myaddr->addr);
+	int dst = *(int *)(toaddr->addr);
+	int time = par->getcurrtime();
+
+	assert(src >= 1 && src <= header->nodes && par->isLocal(src));
+	assert(dst <= MAX_NODES);
+
+	if ( dropMessage(size) || dst < 1 || dst > header->nodes || size > header->msgSize ) {
+		return 0;
+	}
+
+	shm_ring *r = ring(src, dst);
+	char *bytes = data(src, dst);
+	unsigned long head = r->head.load(memory_order_relaxed);
+	unsigned long tail = r->tail.load(memory_order_acquire);
+	unsigned long need = (sizeof(shm_record) + size + 7) & ~7UL;
+	unsigned long room = header->ringSize - (head & mask);
+
+	// A message that would run past the end starts the next lap, after a padding record
+	unsigned long pad = ( room < need ) ? room : 0;
+	if ( head + pad + need - tail > (unsigned long)header->ringSize ) {
+		dropOverflow++;
+		return 0;
+	}
+	if ( pad > 0 ) {
+		((shm_record *)(bytes + (head & mask)))->size = -1;
+		head += pad;
+	}
+	shm_record *rec = (shm_record *)(bytes + (head & mask));
+	rec->size = size;
+	rec->time = time;
+	memcpy(rec + 1, buffer, size);
+	r->head.store(head + need, memory_order_release);
+	pushed++;
+
+	en_stat &sent = stat(src, time);
+	sent.sent_msgs++;
+	sent.sent_bytes += size;
+	if ( par->getZone(src) != par->getZone(dst) ) {
+		crossZoneBytes += size;
+	}
+
+	return size;
+}
+
+/**
+ * FUNCTION NAME: drain
+ *
+ * DESCRIPTION: Take the published messages of every ring into dst, queueing them when deliver is set.
+ * 				A message from another process is taken from the tick after it was sent on,
+ * 				whichever process gets to its tick first.
+ *
+ * RETURNS:
+ * number of messages taken
+ */
+int ShmNet::drain(int dst, bool deliver, int (* enq)(void *, char *, int), void *queue) {
+	int time = par->getcurrtime();
+	int taken = 0;
+
+	for ( int src = 1; src <= header->nodes; src++ ) {
+		shm_ring *r = ring(src, dst);
+		unsigned long tail = r->tail.load(memory_order_relaxed);
+		unsigned long head = r->head.load(memory_order_acquire);
+		if ( tail == head ) {
+			continue;
+		}
+		char *bytes = data(src, dst);
+		bool remote = !par->isLocal(src);
+		while ( tail != head ) {
+			shm_record *rec = (shm_record *)(bytes + (tail & mask));
+			if ( rec->size < 0 ) {
+				tail += header->ringSize - (tail & mask);
+				continue;
+			}
+			if ( deliver && remote && rec->time >= time ) {
+				break;
+			}
+			if ( deliver ) {
+				char *buffer = ENalloc(rec->size);
+				memcpy(buffer, rec + 1, rec->size);
+				(*enq)(queue, buffer, rec->size);
+
+				en_stat &received = stat(dst, time);
+				received.recv_msgs++;
+				received.recv_bytes += rec->size;
+			}
+			tail += (sizeof(shm_record) + rec->size + 7) & ~7UL;
+			taken++;
+		}
+		// Hand the bytes back to the producer
+		r->tail.store(tail, memory_order_release);
+	}
+
+	return taken;
+}
+
+/**
+ * FUNCTION NAME: ENrecv
+ *
+ * DESCRIPTION: Copy every due message of this node's rings into a payload buffer and queue it.
+ * 				Only the destination consumes its rings, so this takes no lock and no system call.
+ */
+int ShmNet::ENrecv(Address *myaddr, int (* enq)(void *, char *, int), struct timeval *t, int times, void *queue) {
+	// times is always assumed to be 1
+	int dst = *(int *)(myaddr->addr);
+
+	if ( dst < 1 || dst > header->nodes ) {
+		return 0;
+	}
+	popped += drain(dst, true, enq, queue);
+
+	return 0;
+}
+
+/**
+ * FUNCTION NAME: ENpurge
+ *
+ * DESCRIPTION: Throw away everything in the rings of a failed node, so its senders find room again
+ *
+ * RETURN:
+ * number of messages dropped
+ */
+int ShmNet::ENpurge(Address *myaddr) {
+	int dst = *(int *)(myaddr->addr);
+
+	if ( dst < 1 || dst > header->nodes ) {
+		return 0;
+	}
+	int purged = drain(dst, false, NULL, NULL);
+	dropFailed += purged;
+
+	return purged;
+}
+
+/**
+ * FUNCTION NAME: waitFor
+ *
+ * DESCRIPTION: Spin until counter reaches value, yielding the core to the other processes.
+ * 				A process that never gets there has died, and the run cannot go on without its nodes.
+ */
+void ShmNet::waitFor(atomic<int> *counter, int value, const char *what) {
+	time_t deadline = 0;
+	while ( counter->load(memory_order_acquire) < value ) {
+		if ( deadline == 0 ) {
+			deadline = time(NULL) + SHM_WAIT;
+		}
+		else if ( time(NULL) > deadline ) {
+			fprintf(stderr, "ShmNet: gave up waiting on segment %s for a process to %s\n", name.c_str(), what);
+			exit(1);
+		}
+		sched_yield();
+	}
+}
+
+/**
+ * FUNCTION NAME: ENflush
+ *
+ * DESCRIPTION: End of a tick. In a run of several processes, wait until every process has sent
+ * 				what its nodes send this tick, so no node starts the next tick without it.
+ */
+int ShmNet::ENflush() {
+	if ( header->procs == 1 ) {
+		return 0;
+	}
+	int done = par->getcurrtime() + 1;
+	header->ticks[par->SHM_PROC].store(done, memory_order_release);
+	for ( int k = 0; k < header->procs; k++ ) {
+		waitFor(&header->ticks[k], done, "finish its tick");
+	}
+	return 0;
+}
+
+/**
+ * FUNCTION NAME: ENcleanup
+ *
+ * DESCRIPTION: Write the traffic report followed by the ring counters.
+ * 				Undelivered messages go away with the segment.
+ */
+int ShmNet::ENcleanup() {
+	EmulNet::ENcleanup();
+
+	FILE* file = fopen("msgcount.log", "a");
+	fprintf(file, "shm segment %s: process %d of %d, %d nodes, %d byte rings, %ld pushed  %ld popped\n",
+			name.c_str(), par->SHM_PROC, header->procs, header->nodes, header->ringSize, pushed, popped);
+	fclose(file);
+	return 0;
+}
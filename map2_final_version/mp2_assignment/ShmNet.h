@@ -0,0 +1,121 @@
+/**********************************
+ * FILE NAME: ShmNet.h
+ *
+ * DESCRIPTION: Header file of the shared memory ring transport
+ **********************************/
+
+#ifndef _SHMNET_H_
+#define _SHMNET_H_
+
+#include "stdincludes.h"
+#include "EmulNet.h"
+#include <atomic>
+#include <errno.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * Macros
+ */
+// Ring heads and tails are padded to a cache line so a producer and its consumer do not share one
+#define SHM_LINE 64
+// Set by the owner once the segment is laid out, attaching processes wait for it
+#define SHM_MAGIC 0x53484d31
+#define SHM_MAX_PROCS 64
+// Seconds a process waits for the others to attach or to finish a tick before giving up on them
+#define SHM_WAIT 60
+
+/**
+ * Struct Name: shm_header
+ *
+ * Start of the segment: the geometry it was laid out with and the state the processes share
+ */
+typedef struct shm_header {
+	atomic<unsigned int> magic;
+	int nodes;
+	int procs;
+	int ringSize;
+	int msgSize;
+	// The owner's seed, so every process injects the same failures
+	unsigned int seed;
+	// Processes that have mapped the segment, the last one unlinks its name
+	atomic<int> attached;
+	// Whether process k has attached, so two processes cannot run the same node ids
+	atomic<int> claimed[SHM_MAX_PROCS];
+	// Ticks process k has finished
+	atomic<int> ticks[SHM_MAX_PROCS];
+}shm_header;
+
+/**
+ * Struct Name: shm_ring
+ *
+ * Head and tail of the byte ring from one node to another. Only the source node writes head
+ * and only the destination writes tail, so neither needs more than a load and a store.
+ * Positions only grow; a zero filled segment is therefore a set of empty rings.
+ */
+typedef struct shm_ring {
+	atomic<unsigned long> head;
+	char headPad[SHM_LINE - sizeof(atomic<unsigned long>)];
+	atomic<unsigned long> tail;
+	char tailPad[SHM_LINE - sizeof(atomic<unsigned long>)];
+}shm_ring;
+
+/**
+ * Struct Name: shm_record
+ *
+ * Header of one message in a ring, the payload follows it. A record of size -1 pads the ring
+ * to its end when the next message does not fit before it.
+ */
+typedef struct shm_record {
+	int size;
+	int time;
+}shm_record;
+
+/**
+ * CLASS NAME: ShmNet
+ *
+ * DESCRIPTION: Implements the EmulNet contract on a POSIX shared memory segment holding one
+ * 				single producer, single consumer byte ring per (source, destination) pair of node ids.
+ * 				Sending and receiving are a copy into and out of a ring, with no system call.
+ * 				A full ring drops the message, as a full network would.
+ * 				With SHM_NAME set, SHM_PROCS processes with the same config meet on one segment.
+ * 				The first one to arrive creates it, the others attach and check its geometry.
+ * 				Process SHM_PROC runs its own range of node ids, see Params::isLocal, and
+ * 				ENflush holds every process at the end of a tick until the others get there.
+ * 				Without SHM_NAME the segment is private to the run.
+ * 				Link delay and bandwidth settings do not apply.
+ */
+class ShmNet : public EmulNet
+{
+private:
+	string name;
+	char *base;
+	size_t length;
+	shm_header *header;
+	// Ring heads and tails, indexed by destination then source, and the ring bytes after them
+	size_t ringOffset;
+	size_t dataOffset;
+	unsigned long mask;
+	long pushed;
+	long popped;
+	int ringIndex(int src, int dst);
+	shm_ring *ring(int src, int dst);
+	char *data(int src, int dst);
+	int drain(int dst, bool deliver, int (* enq)(void *, char *, int), void *queue);
+	void waitFor(atomic<int> *counter, int value, const char *what);
+	// The mapping belongs to one instance, so it is not copied
+	ShmNet(ShmNet &anotherShmNet);
+	ShmNet& operator = (ShmNet &anotherShmNet);
+public:
+	ShmNet(Params *p, int instance);
+	virtual ~ShmNet();
+	void *ENinit(Address *myaddr, short port);
+	int ENsendBuffer(Address *myaddr, Address *toaddr, char *buffer);
+	int ENrecv(Address *myaddr, int (* enq)(void *, char *, int), struct timeval *t, int times, void *queue);
+	int ENpurge(Address *myaddr);
+	int ENflush();
+	int ENcleanup();
+};
+
+#endif /* _SHMNET_H_ */
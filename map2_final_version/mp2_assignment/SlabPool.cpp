@@ -0,0 +1,118 @@
+/**********************************
+ * FILE NAME: SlabPool.cpp
+ *
+ * DESCRIPTION: Definition of the size class slab allocator
+ **********************************/
+
+#include "SlabPool.h"
+
+/**
+ * Constructor
+ */
+SlabPool::SlabPool() {
+	for ( int i = 0; i < SLAB_CLASSES; i++ ) {
+		freeList[i] = NULL;
+		slabCount[i] = 0;
+		inUse[i] = 0;
+		highWater[i] = 0;
+		allocCount[i] = 0;
+	}
+	heapAllocs = 0;
+	heapInUse = 0;
+	heapHighWater = 0;
+}
+
+/**
+ * Destructor
+ */
+SlabPool::~SlabPool() {
+	for ( unsigned int i = 0; i < slabs.size(); i++ ) {
+		free(slabs[i]);
+	}
+}
+
+/**
+ * FUNCTION NAME: sizeClass
+ *
+ * DESCRIPTION: Smallest class whose blocks hold size bytes
+ *
+ * RETURNS:
+ * class index, or -1 if the request is too large for the pool
+ */
+int SlabPool::sizeClass(int size) {
+	for ( int cls = 0; cls < SLAB_CLASSES; cls++ ) {
+		if ( size <= (1 << (SLAB_MIN_SHIFT + cls)) ) {
+			return cls;
+		}
+	}
+	return -1;
+}
+
+/**
+ * FUNCTION NAME: grow
+ *
+ * DESCRIPTION: Carve a new slab into SLAB_BLOCKS blocks and push them on the free list of cls
+ */
+void SlabPool::grow(int cls) {
+	int blockSize = 1 << (SLAB_MIN_SHIFT + cls);
+	char *slab = (char *) malloc(blockSize * SLAB_BLOCKS);
+	slabs.push_back(slab);
+	slabCount[cls]++;
+	for ( int i = SLAB_BLOCKS - 1; i >= 0; i-- ) {
+		char *block = slab + i * blockSize;
+		*(void **)block = freeList[cls];
+		freeList[cls] = block;
+	}
+}
+
+/**
+ * FUNCTION NAME: alloc
+ *
+ * DESCRIPTION: Get a block of at least size bytes
+ */
+void *SlabPool::alloc(int size) {
+	int cls = sizeClass(size);
+	if ( cls < 0 ) {
+		heapAllocs++;
+		heapHighWater = max(heapHighWater, ++heapInUse);
+		return malloc(size);
+	}
+	if ( freeList[cls] == NULL ) {
+		grow(cls);
+	}
+	void *block = freeList[cls];
+	freeList[cls] = *(void **)block;
+	allocCount[cls]++;
+	highWater[cls] = max(highWater[cls], ++inUse[cls]);
+	return block;
+}
+
+/**
+ * FUNCTION NAME: release
+ *
+ * DESCRIPTION: Give back a block from alloc. size must be the size it was allocated with.
+ */
+void SlabPool::release(void *block, int size) {
+	int cls = sizeClass(size);
+	if ( cls < 0 ) {
+		heapInUse--;
+		free(block);
+		return;
+	}
+	*(void **)block = freeList[cls];
+	freeList[cls] = block;
+	inUse[cls]--;
+}
+
+/**
+ * FUNCTION NAME: report
+ *
+ * DESCRIPTION: Write occupancy and high-water marks of every class to file
+ */
+void SlabPool::report(FILE *file) {
+	for ( int cls = 0; cls < SLAB_CLASSES; cls++ ) {
+		fprintf(file, "pool %4d B blocks: allocs %8ld  in use %6d  high water %6d  capacity %6d\n",
+				1 << (SLAB_MIN_SHIFT + cls), allocCount[cls], inUse[cls], highWater[cls], slabCount[cls] * SLAB_BLOCKS);
+	}
+	fprintf(file, "pool heap fallback: allocs %8ld  in use %6d  high water %6d\n", heapAllocs, heapInUse, heapHighWater);
+}
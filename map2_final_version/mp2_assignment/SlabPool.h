@@ -0,0 +1,53 @@
+/**********************************
+ * FILE NAME: SlabPool.h
+ *
+ * DESCRIPTION: Header file of the size class slab allocator used for in-flight messages
+ **********************************/
+
+#ifndef SLABPOOL_H_
+#define SLABPOOL_H_
+
+#include "stdincludes.h"
+
+/*
+ * Macros
+ */
+// Smallest block is 1 << SLAB_MIN_SHIFT bytes, each class doubles the block size
+#define SLAB_MIN_SHIFT 6
+#define SLAB_CLASSES 7
+// Number of blocks carved out of one malloc'd slab
+#define SLAB_BLOCKS 64
+
+/**
+ * CLASS NAME: SlabPool
+ *
+ * DESCRIPTION: Recycles fixed size blocks through one free list per size class.
+ * 				Requests larger than the biggest class go straight to the heap.
+ */
+class SlabPool {
+private:
+	// Head of the free list of each class; a free block stores the next pointer in its first bytes
+	void *freeList[SLAB_CLASSES];
+	// Every slab ever allocated, released when the pool goes away
+	vector<char *> slabs;
+	int slabCount[SLAB_CLASSES];
+	int inUse[SLAB_CLASSES];
+	int highWater[SLAB_CLASSES];
+	long allocCount[SLAB_CLASSES];
+	long heapAllocs;
+	int heapInUse;
+	int heapHighWater;
+	int sizeClass(int size);
+	void grow(int cls);
+	// Blocks belong to exactly one pool, so pools are not copied
+	SlabPool(const SlabPool &anotherPool);
+	SlabPool& operator = (const SlabPool &anotherPool);
+public:
+	SlabPool();
+	void *alloc(int size);
+	void release(void *block, int size);
+	void report(FILE *file);
+	virtual ~SlabPool();
+};
+
+#endif /* SLABPOOL_H_ */
@@ -0,0 +1,85 @@
+/**********************************
+ * FILE NAME: SweepBenchmark.cpp
+ *
+ * DESCRIPTION: Microbenchmark of the MP1 T_REMOVE sweep over a large member table.
+ * 				Times a scan of the memberList entries, a scalar scan of the timestamp column and
+ * 				MP1Node::sweep_expired over the same timestamps, and checks they agree.
+ *
+ * RUN PROCEDURE:
+ * $ make SweepBenchmark
+ * $ ./SweepBenchmark [members] [sweeps]
+ **********************************/
+
+#include "MP1Node.h"
+#include <chrono>
+
+/**
+ * FUNCTION NAME: nowNsec
+ *
+ * DESCRIPTION: Monotonic wall clock in nanoseconds
+ */
+static double nowNsec() {
+	return chrono::duration<double, nano>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int main(int argc, char *argv[]) {
+	int members = argc > 1 ? atoi(argv[1]) : 10000;
+	int sweeps = argc > 2 ? atoi(argv[2]) : 10000;
+	int tremove = 20;
+	int now = 1000;
+	int deadline = now - tremove;
+	vector<MemberListEntry> list;
+	vector<int> seen(members);
+	vector<int> out(members);
+	long found[3] = {0, 0, 0};
+	double start, elapsed[3];
+	int i, s;
+
+	// About 1% of the members expired, the rest heard from within T_REMOVE
+	srand(1);
+	for ( i = 0; i < members; i++ ) {
+		seen[i] = rand() % 100 == 0 ? deadline - rand() % 10 : now - rand() % tremove;
+		list.push_back(MemberListEntry(i + 1, 0, i, seen[i]));
+	}
+
+	start = nowNsec();
+	for ( s = 0; s < sweeps; s++ ) {
+		int count = 0;
+		for ( i = 0; i < members; i++ ) {
+			if ( now - list[i].gettimestamp() >= tremove ) {
+				out[count++] = i;
+			}
+		}
+		found[0] += count;
+	}
+	elapsed[0] = nowNsec() - start;
+
+	start = nowNsec();
+	for ( s = 0; s < sweeps; s++ ) {
+		int count = 0;
+		const int *column = &seen[0];
+		for ( i = 0; i < members; i++ ) {
+			if ( column[i] <= deadline ) {
+				out[count++] = i;
+			}
+		}
+		found[1] += count;
+	}
+	elapsed[1] = nowNsec() - start;
+
+	start = nowNsec();
+	for ( s = 0; s < sweeps; s++ ) {
+		found[2] += MP1Node::sweep_expired(&seen[0], members, deadline, &out[0]);
+	}
+	elapsed[2] = nowNsec() - start;
+
+	if ( found[0] != found[1] || found[1] != found[2] ) {
+		printf("sweeps disagree: %ld %ld %ld\n", found[0], found[1], found[2]);
+		return 1;
+	}
+	printf("sweep over %d members, %ld expired:\n", members, found[0] / sweeps);
+	printf("  memberList entries   %8.0f ns\n", elapsed[0] / sweeps);
+	printf("  timestamp column     %8.0f ns\n", elapsed[1] / sweeps);
+	printf("  sweep_expired        %8.0f ns\n", elapsed[2] / sweeps);
+	return 0;
+}
@@ -0,0 +1,316 @@
+/**********************************
+ * FILE NAME: UdpNet.cpp
+ *
+ * DESCRIPTION: Definition of the UDP loopback transport
+ **********************************/
+
+#include "UdpNet.h"
+
+/**
+ * Constructor
+ */
+UdpNet::UdpNet(Params *p, int instance): EmulNet(p, instance) {
+	basePort = par->UDP_PORT + instance * (MAX_NODES + 1);
+	epfd = epoll_create1(0);
+	if ( epfd < 0 ) {
+		perror("UdpNet: epoll_create1");
+		exit(1);
+	}
+	polledAt = -1;
+	sentSincePoll = false;
+	pendingOut = 0;
+	hdrs.resize(par->UDP_BATCH);
+	iovs.resize(par->UDP_BATCH);
+	addrs.resize(par->UDP_BATCH);
+	recvBuf.resize(par->UDP_BATCH * par->MAX_MSG_SIZE);
+	sendCalls = 0;
+	recvCalls = 0;
+	pollCalls = 0;
+	sentDatagrams = 0;
+	recvDatagrams = 0;
+}
+
+/**
+ * Destructor
+ */
+UdpNet::~UdpNet() {
+	closeSockets();
+}
+
+/**
+ * FUNCTION NAME: loopback
+ *
+ * DESCRIPTION: Socket address of node id
+ */
+struct sockaddr_in UdpNet::loopback(int id) {
+	struct sockaddr_in sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	sa.sin_port = htons(basePort + id);
+	return sa;
+}
+
+/**
+ * FUNCTION NAME: ENinit
+ *
+ * DESCRIPTION: Give the node its id, then bind a non-blocking socket to its loopback port
+ * 				and register it with epoll
+ */
+void *UdpNet::ENinit(Address *myaddr, short port) {
+	EmulNet::ENinit(myaddr, port);
+	int id = *(int *)(myaddr->addr);
+
+	if ( id >= (int)fds.size() ) {
+		fds.resize(id + 1, -1);
+		readable.resize(id + 1, 0);
+		events.resize(id + 1);
+		outbox.resize(id + 1);
+	}
+	if ( fds[id] >= 0 ) {
+		return myaddr;
+	}
+
+	int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+	int sockbuf = UDP_SOCKBUF;
+	struct sockaddr_in sa = loopback(id);
+	if ( fd < 0 || bind(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0 ) {
+		fprintf(stderr, "UdpNet: cannot bind node %d to port %d: %s\n", id, basePort + id, strerror(errno));
+		exit(1);
+	}
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &sockbuf, sizeof(sockbuf));
+
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.u32 = id;
+	epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+	fds[id] = fd;
+
+	return myaddr;
+}
+
+/**
+ * FUNCTION NAME: ENsendBuffer
+ *
+ * DESCRIPTION: Queue the payload as a datagram from the sender's socket to the destination port.
+ * 				The queue holds a reference until ENflush hands the payload to the kernel.
+ *
+ * RETURNS:
+ * size
+ */
+int UdpNet::ENsendBuffer(Address *myaddr, Address *toaddr, char *buffer) {
+	en_buf *buf = (en_buf *)buffer - 1;
+	int size = buf->size;
+	int src = *(int *)(myaddr->addr);
+	int dst = *(int *)(toaddr->addr);
+	int time = par->getcurrtime();
+
+	assert(src <= MAX_NODES);
+	assert(dst >= 0 && dst <= MAX_NODES);
+
+	if ( dropMessage(size) || src < 0 || src >= (int)fds.size() || fds[src] < 0 ) {
+		return 0;
+	}
+
+	udp_out out;
+	out.dst = dst;
+	out.buffer = buffer;
+	out.size = size;
+	buf->refcount++;
+	outbox[src].push_back(out);
+	pendingOut++;
+	if ( (int)outbox[src].size() >= par->UDP_BATCH ) {
+		flushNode(src);
+	}
+
+	en_stat &sent = stat(src, time);
+	sent.sent_msgs++;
+	sent.sent_bytes += size;
+	if ( par->getZone(src) != par->getZone(dst) ) {
+		crossZoneBytes += size;
+	}
+
+	return size;
+}
+
+/**
+ * FUNCTION NAME: flushNode
+ *
+ * DESCRIPTION: Send the datagrams queued by node src with as few sendmmsg calls as possible.
+ * 				Whatever the kernel refuses is dropped as an overflow, as a full network would.
+ */
+void UdpNet::flushNode(int src) {
+	vector<udp_out> &queued = outbox[src];
+	int total = queued.size();
+	int done = 0;
+
+	while ( done < total ) {
+		int chunk = min(par->UDP_BATCH, total - done);
+		for ( int k = 0; k < chunk; k++ ) {
+			udp_out &out = queued[done + k];
+			addrs[k] = loopback(out.dst);
+			iovs[k].iov_base = out.buffer;
+			iovs[k].iov_len = out.size;
+			memset(&hdrs[k], 0, sizeof(struct mmsghdr));
+			hdrs[k].msg_hdr.msg_name = &addrs[k];
+			hdrs[k].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+			hdrs[k].msg_hdr.msg_iov = &iovs[k];
+			hdrs[k].msg_hdr.msg_iovlen = 1;
+		}
+		int n = sendmmsg(fds[src], &hdrs[0], chunk, 0);
+		sendCalls++;
+		if ( n <= 0 ) {
+			dropOverflow += total - done;
+			break;
+		}
+		sentDatagrams += n;
+		done += n;
+	}
+
+	for ( int k = 0; k < total; k++ ) {
+		ENrelease(queued[k].buffer);
+	}
+	pendingOut -= total;
+	queued.clear();
+	sentSincePoll = true;
+}
+
+/**
+ * FUNCTION NAME: ENflush
+ *
+ * DESCRIPTION: Send every queued datagram. Called once the nodes are done sending for the tick.
+ */
+int UdpNet::ENflush() {
+	if ( pendingOut == 0 ) {
+		return 0;
+	}
+	for ( int src = 0; src < (int)outbox.size(); src++ ) {
+		if ( !outbox[src].empty() ) {
+			flushNode(src);
+		}
+	}
+	return 0;
+}
+
+/**
+ * FUNCTION NAME: pollSockets
+ *
+ * DESCRIPTION: Ask epoll once which node sockets have datagrams waiting
+ */
+void UdpNet::pollSockets() {
+	fill(readable.begin(), readable.end(), 0);
+	polledAt = par->getcurrtime();
+	sentSincePoll = false;
+	if ( events.empty() ) {
+		return;
+	}
+	int n = epoll_wait(epfd, &events[0], events.size(), 0);
+	pollCalls++;
+	for ( int i = 0; i < n; i++ ) {
+		readable[events[i].data.u32] = 1;
+	}
+}
+
+/**
+ * FUNCTION NAME: ENrecv
+ *
+ * DESCRIPTION: Read every datagram waiting on this node's socket into payload buffers and queue them.
+ * 				Queued sends are flushed first so nothing sent earlier is missed.
+ * 				Sockets are polled at most once per tick unless something was sent meanwhile,
+ * 				so nodes with nothing waiting cost no system call.
+ */
+int UdpNet::ENrecv(Address *myaddr, int (* enq)(void *, char *, int), struct timeval *t, int times, void *queue) {
+	// times is always assumed to be 1
+	int dst = *(int *)(myaddr->addr);
+	int time = par->getcurrtime();
+	int batch = par->UDP_BATCH;
+	int n;
+
+	if ( dst < 0 || dst >= (int)fds.size() || fds[dst] < 0 ) {
+		return 0;
+	}
+	ENflush();
+	if ( polledAt != time || sentSincePoll ) {
+		pollSockets();
+	}
+	if ( !readable[dst] ) {
+		return 0;
+	}
+	readable[dst] = 0;
+
+	do {
+		for ( int k = 0; k < batch; k++ ) {
+			iovs[k].iov_base = &recvBuf[k * par->MAX_MSG_SIZE];
+			iovs[k].iov_len = par->MAX_MSG_SIZE;
+			memset(&hdrs[k], 0, sizeof(struct mmsghdr));
+			hdrs[k].msg_hdr.msg_iov = &iovs[k];
+			hdrs[k].msg_hdr.msg_iovlen = 1;
+		}
+		n = recvmmsg(fds[dst], &hdrs[0], batch, MSG_DONTWAIT, NULL);
+		recvCalls++;
+
+		for ( int k = 0; k < n; k++ ) {
+			int size = hdrs[k].msg_len;
+			if ( hdrs[k].msg_hdr.msg_flags & MSG_TRUNC ) {
+				continue;
+			}
+			char *buffer = ENalloc(size);
+			memcpy(buffer, iovs[k].iov_base, size);
+			(*enq)(queue, buffer, size);
+			recvDatagrams++;
+
+			en_stat &received = stat(dst, time);
+			received.recv_msgs++;
+			received.recv_bytes += size;
+		}
+		// A short batch means the socket is drained
+	} while ( n == batch );
+
+	return 0;
+}
+
+/**
+ * FUNCTION NAME: closeSockets
+ *
+ * DESCRIPTION: Close every node socket and the epoll instance
+ */
+void UdpNet::closeSockets() {
+	for ( int i = 0; i < (int)fds.size(); i++ ) {
+		if ( fds[i] >= 0 ) {
+			close(fds[i]);
+			fds[i] = -1;
+		}
+	}
+	if ( epfd >= 0 ) {
+		close(epfd);
+		epfd = -1;
+	}
+}
+
+/**
+ * FUNCTION NAME: ENcleanup
+ *
+ * DESCRIPTION: Drop unsent and undelivered datagrams with the sockets, then write the traffic
+ * 				report followed by the syscall counters
+ */
+int UdpNet::ENcleanup() {
+	for ( int src = 0; src < (int)outbox.size(); src++ ) {
+		for ( int k = 0; k < (int)outbox[src].size(); k++ ) {
+			ENrelease(outbox[src][k].buffer);
+		}
+		outbox[src].clear();
+	}
+	pendingOut = 0;
+	closeSockets();
+	EmulNet::ENcleanup();
+
+	FILE* file = fopen("msgcount.log", "a");
+	long messages = sentDatagrams + recvDatagrams;
+	fprintf(file, "udp sendmmsg calls %ld for %ld datagrams\n", sendCalls, sentDatagrams);
+	fprintf(file, "udp recvmmsg calls %ld for %ld datagrams, epoll_wait calls %ld\n", recvCalls, recvDatagrams, pollCalls);
+	fprintf(file, "udp syscalls per message %.3f\n",
+			messages ? (double)(sendCalls + recvCalls + pollCalls) / messages : 0.0);
+	fclose(file);
+	return 0;
+}
@@ -0,0 +1,91 @@
+/**********************************
+ * FILE NAME: UdpNet.h
+ *
+ * DESCRIPTION: Header file of the UDP loopback transport
+ **********************************/
+
+#ifndef _UDPNET_H_
+#define _UDPNET_H_
+
+#include "stdincludes.h"
+#include "EmulNet.h"
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+/*
+ * Macros
+ */
+// Kernel receive buffer asked for each node socket
+#define UDP_SOCKBUF (1 << 20)
+
+/**
+ * Struct Name: udp_out
+ *
+ * A datagram queued by ENsendBuffer until the next flush
+ */
+typedef struct udp_out {
+	int dst;
+	// Payload from ENalloc, the queue holds a reference
+	char *buffer;
+	int size;
+}udp_out;
+
+/**
+ * CLASS NAME: UdpNet
+ *
+ * DESCRIPTION: Implements the EmulNet contract with non-blocking UDP sockets on 127.0.0.1.
+ * 				Node id n is bound to port UDP_PORT + n, shifted by MAX_NODES + 1 per instance
+ * 				so the MP1 and MP2 networks of one run do not collide.
+ * 				Link delay and bandwidth settings do not apply, the kernel delivers the datagrams.
+ * 				Sends are queued per node and leave in batches of UDP_BATCH with sendmmsg;
+ * 				ENrecv drains a socket with recvmmsg.
+ */
+class UdpNet : public EmulNet
+{
+private:
+	// Loopback port of node id 0 in this instance
+	int basePort;
+	int epfd;
+	// Socket of each node, indexed by node id, -1 until ENinit binds it
+	vector<int> fds;
+	// Nodes epoll reported readable at the last poll
+	vector<char> readable;
+	vector<struct epoll_event> events;
+	// Tick of the last poll, and whether anything was sent since
+	int polledAt;
+	bool sentSincePoll;
+	// Datagrams waiting for ENflush, per sending node
+	vector< vector<udp_out> > outbox;
+	int pendingOut;
+	// Scratch space of one sendmmsg or recvmmsg call, UDP_BATCH entries
+	vector<struct mmsghdr> hdrs;
+	vector<struct iovec> iovs;
+	vector<struct sockaddr_in> addrs;
+	vector<char> recvBuf;
+	// Syscall counters
+	long sendCalls;
+	long recvCalls;
+	long pollCalls;
+	long sentDatagrams;
+	long recvDatagrams;
+	struct sockaddr_in loopback(int id);
+	void flushNode(int src);
+	void pollSockets();
+	void closeSockets();
+	// Sockets belong to one instance, so it is not copied
+	UdpNet(UdpNet &anotherUdpNet);
+	UdpNet& operator = (UdpNet &anotherUdpNet);
+public:
+	UdpNet(Params *p, int instance);
+	virtual ~UdpNet();
+	void *ENinit(Address *myaddr, short port);
+	int ENsendBuffer(Address *myaddr, Address *toaddr, char *buffer);
+	int ENrecv(Address *myaddr, int (* enq)(void *, char *, int), struct timeval *t, int times, void *queue);
+	int ENflush();
+	int ENcleanup();
+};
+
+#endif /* _UDPNET_H_ */
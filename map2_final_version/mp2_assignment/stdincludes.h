@@ -34,6 +34,7 @@
 #include <string>
 #include <algorithm>
 #include <queue>
+#include <deque>
 #include <fstream>
 
 using namespace std;